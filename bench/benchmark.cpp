@@ -0,0 +1,204 @@
+#include "matching_engine.hpp"
+#include "workload.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+*  Measures MatchingEngine on synthetic order flow, for a range of book sizes.
+*
+*  For every size a workload is generated, the books are filled, then the operations are applied
+*  twice on fresh engines: once back to back for the throughput, once with every call timed on
+*  its own for the latency percentiles. Trades go to a NullSink, so formatting is not measured.
+*  The same session is then journaled and replayed on a fresh engine, for the recovery throughput.
+*
+*  Usage: MatchingEngineBenchmark [--orders 1000,10000,...] [--operations N] [--symbols N]
+*                                 [--depth N] [--aggressive RATIO] [--mix INSERT:AMEND:PULL] [--seed N]
+*                                 [--book sorted|ladder] [--publish DEPTH]
+*
+*  --book picks how the engine stores its price levels, the same workload runs on either.
+*  --publish has the engine write the top DEPTH levels of the book each operation changed to
+*  shared memory, so the difference with a run without it is the publication cost.
+*/
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    constexpr std::array<const char*, 4> operation_names = {"insert", "amend", "pull", "match"};
+
+    struct Options {
+        std::vector<std::size_t> book_sizes {1000, 10000, 100000, 1000000};
+        bench::WorkloadConfig workload {};
+    };
+
+    std::vector<std::size_t> parseSizes(const char* text) {
+        std::vector<std::size_t> sizes;
+        for (const char* field = text; *field != '\0';) {
+            char* end;
+            sizes.push_back(std::strtoull(field, &end, 10));
+            if (end == field || sizes.back() == 0) throw std::invalid_argument(text);
+            field = *end == ',' ? end + 1 : end;
+        }
+        return sizes;
+    }
+
+    Options parseOptions(int argc, char** argv) {
+        Options options;
+        for (int i = 1; i + 1 < argc; i += 2) {
+            const std::string flag = argv[i];
+            const char* value = argv[i + 1];
+            if (flag == "--orders") {
+                options.book_sizes = parseSizes(value);
+            } else if (flag == "--operations") {
+                options.workload.operations = std::stoull(value);
+            } else if (flag == "--symbols") {
+                options.workload.symbols = std::stoull(value);
+            } else if (flag == "--depth") {
+                options.workload.depth = std::stoull(value);
+            } else if (flag == "--aggressive") {
+                options.workload.aggressive_ratio = std::stod(value);
+            } else if (flag == "--seed") {
+                options.workload.seed = std::stoull(value);
+            } else if (flag == "--book") {
+                if (std::strcmp(value, "sorted") == 0) {
+                    options.workload.book_type = engine::BookType::sorted;
+                } else if (std::strcmp(value, "ladder") == 0) {
+                    options.workload.book_type = engine::BookType::ladder;
+                } else {
+                    throw std::invalid_argument(value);
+                }
+            } else if (flag == "--publish") {
+                options.workload.publish_depth = std::stoull(value);
+            } else if (flag == "--mix") {
+                if (std::sscanf(value, "%lf:%lf:%lf", &options.workload.insert_weight,
+                                &options.workload.amend_weight, &options.workload.pull_weight) != 3) {
+                    throw std::invalid_argument(value);
+                }
+            } else {
+                throw std::invalid_argument(flag);
+            }
+        }
+        if (argc % 2 == 0) throw std::invalid_argument(argv[argc - 1]);
+        if (options.workload.symbols == 0 || options.workload.depth == 0) throw std::invalid_argument("empty books");
+        return options;
+    }
+
+    /*! \brief Fresh engine with the workload's symbols and books.
+    */
+    struct PreparedEngine {
+        PreparedEngine(const bench::Workload& workload, const bench::WorkloadConfig& config)
+            : matching_engine(sink, bench::engineConfigFor(config))
+        {
+            for (const auto& symbol: workload.symbols) matching_engine.registerSymbol(symbol);
+            for (const auto& operation: workload.prefill) matching_engine.processMessage(operation.message);
+            if (config.publish_depth > 0) {
+                publisher = std::make_unique<engine::SharedBookPublisher>("/matching_engine_benchmark", workload.symbols.size(),
+                                                                          config.publish_depth);
+                matching_engine.setBookPublisher(publisher.get());
+            }
+        }
+
+        engine::NullSink sink {};
+        // Outlives the engine that writes to it
+        std::unique_ptr<engine::SharedBookPublisher> publisher {};
+        MatchingEngine matching_engine;
+    };
+
+    double throughput(const bench::Workload& workload, const bench::WorkloadConfig& config) {
+        PreparedEngine prepared(workload, config);
+        const auto start = Clock::now();
+        for (const auto& operation: workload.operations) {
+            prepared.matching_engine.processMessage(operation.message);
+        }
+        const std::chrono::duration<double> elapsed = Clock::now() - start;
+        return workload.operations.size() / elapsed.count();
+    }
+
+    std::array<std::vector<uint32_t>, 4> latencies(const bench::Workload& workload, const bench::WorkloadConfig& config) {
+        PreparedEngine prepared(workload, config);
+        std::array<std::vector<uint32_t>, 4> samples;
+        for (auto& kind_samples: samples) kind_samples.reserve(workload.operations.size());
+        for (const auto& operation: workload.operations) {
+            const auto start = Clock::now();
+            prepared.matching_engine.processMessage(operation.message);
+            const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+            samples[static_cast<std::size_t>(operation.kind)].push_back(static_cast<uint32_t>(elapsed));
+        }
+        return samples;
+    }
+
+    double replayThroughput(const bench::Workload& workload, const bench::WorkloadConfig& config) {
+        const std::string path = "matching_engine_benchmark.journal";
+        std::remove(path.c_str());
+        {
+            // Synced once at the end, only the replay is measured
+            engine::JournalConfig journal_config;
+            journal_config.sync_every_messages = 0;
+            journal_config.sync_interval = std::chrono::microseconds(0);
+            engine::JournalWriter journal(path, journal_config);
+            engine::NullSink sink;
+            MatchingEngine matching_engine(sink, bench::engineConfigFor(config));
+            matching_engine.setJournal(&journal);
+            for (const auto& symbol: workload.symbols) matching_engine.registerSymbol(symbol);
+            for (const auto& operation: workload.prefill) matching_engine.processMessage(operation.message);
+            for (const auto& operation: workload.operations) matching_engine.processMessage(operation.message);
+            matching_engine.setJournal(nullptr);
+        }
+        engine::NullSink sink;
+        MatchingEngine recovered(sink, bench::engineConfigFor(config));
+        const auto start = Clock::now();
+        const auto result = recovered.replay(path);
+        const std::chrono::duration<double> elapsed = Clock::now() - start;
+        std::remove(path.c_str());
+        return result.messages / elapsed.count();
+    }
+
+    uint32_t percentile(const std::vector<uint32_t>& sorted, double fraction) {
+        const auto index = static_cast<std::size_t>(fraction * (sorted.size() - 1));
+        return sorted[index];
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    try {
+        options = parseOptions(argc, argv);
+    } catch (const std::exception& error) {
+        std::fprintf(stderr, "Invalid argument: %s\n", error.what());
+        return 2;
+    }
+
+    std::printf("%10s %12s %12s  %-7s %10s %8s %8s %8s %8s %10s\n",
+                "orders", "ops/s", "replay/s", "op", "count", "p50", "p90", "p99", "p99.9", "max (ns)");
+    for (const auto book_size: options.book_sizes) {
+        auto config = options.workload;
+        config.resting_orders = book_size;
+        try {
+            const auto workload = bench::generateWorkload(config);
+            const double operations_per_second = throughput(workload, config);
+            auto samples = latencies(workload, config);
+            const double replayed_per_second = replayThroughput(workload, config);
+            for (std::size_t kind = 0; kind < samples.size(); ++kind) {
+                auto& kind_samples = samples[kind];
+                if (kind_samples.empty()) continue;
+                std::sort(kind_samples.begin(), kind_samples.end());
+                std::printf("%10zu %12.0f %12.0f  %-7s %10zu %8u %8u %8u %8u %10u\n",
+                            book_size, operations_per_second, replayed_per_second, operation_names[kind], kind_samples.size(),
+                            percentile(kind_samples, 0.5), percentile(kind_samples, 0.9),
+                            percentile(kind_samples, 0.99), percentile(kind_samples, 0.999), kind_samples.back());
+            }
+        } catch (const std::runtime_error& error) {
+            std::fprintf(stderr, "%s\n", error.what());
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,162 @@
+#include "workload.hpp"
+
+#include <algorithm>
+
+namespace bench {
+
+namespace {
+    constexpr order::Price tick = order::price_scale / 100;
+    constexpr order::Price mid_price = 100 * order::price_scale;
+
+    /*! \brief Counts trades, to tell inserts that matched from the ones that only rested.
+    */
+    class CountingSink : public engine::TradeSink {
+        public:
+            void onTrade(const engine::TradeEvent&) override { ++trades; }
+
+            std::size_t trades = 0;
+    };
+
+    struct LiveOrder {
+        order::Id id;
+        engine::SymbolId symbol;
+        order::Side side;
+        order::Price price;
+        int volume;
+    };
+
+    class Generator {
+        public:
+            explicit Generator(const WorkloadConfig& config)
+                : mConfig(config)
+                , mRandom(config.seed)
+                , mDistance(1.0 - std::min(std::max(config.depth_decay, 0.0), 0.999))
+                , mEngine(mSink, engineConfigFor(config))
+            {
+                mLive.reserve(config.resting_orders + config.resting_orders / 4);
+            }
+
+            Workload run() {
+                Workload workload;
+                for (std::size_t i = 0; i < mConfig.symbols; ++i) {
+                    workload.symbols.push_back("SYM" + std::to_string(i));
+                    mEngine.registerSymbol(workload.symbols.back());
+                }
+                workload.prefill.reserve(mConfig.resting_orders);
+                for (std::size_t i = 0; i < mConfig.resting_orders; ++i) {
+                    workload.prefill.push_back(insert(false));
+                }
+                workload.operations.reserve(mConfig.operations);
+                for (std::size_t i = 0; i < mConfig.operations; ++i) {
+                    workload.operations.push_back(next());
+                }
+                return workload;
+            }
+
+        private:
+            WorkloadConfig mConfig;
+            std::mt19937_64 mRandom;
+            std::geometric_distribution<int> mDistance;
+            CountingSink mSink {};
+            MatchingEngine mEngine;
+            // Orders that may still rest, filled ones are only dropped when they get picked
+            std::vector<LiveOrder> mLive {};
+            order::Id mNextId = 1;
+
+            double uniform() {
+                return std::uniform_real_distribution<double>(0.0, 1.0)(mRandom);
+            }
+
+            std::size_t below(std::size_t bound) {
+                return std::uniform_int_distribution<std::size_t>(0, bound - 1)(mRandom);
+            }
+
+            order::Price passivePrice(order::Side side) {
+                const auto distance = std::min<std::size_t>(mDistance(mRandom), mConfig.depth - 1);
+                const order::Price offset = tick * static_cast<order::Price>(1 + distance);
+                return side == order::Side::buy ? mid_price - offset : mid_price + offset;
+            }
+
+            order::Price aggressivePrice(order::Side side) {
+                // A few ticks through the touch, so some orders sweep more than one level
+                const order::Price offset = tick * static_cast<order::Price>(1 + below(3));
+                return side == order::Side::buy ? mid_price + offset : mid_price - offset;
+            }
+
+            Operation apply(OperationKind kind, const protocol::Message& message) {
+                const std::size_t trades = mSink.trades;
+                mEngine.processMessage(message);
+                if (kind == OperationKind::insert && mSink.trades != trades) kind = OperationKind::match;
+                return {kind, message};
+            }
+
+            Operation insert(bool aggressive) {
+                const auto side = below(2) ? order::Side::buy : order::Side::sell;
+                const auto symbol = static_cast<engine::SymbolId>(below(mConfig.symbols));
+                const order::Price price = aggressive ? aggressivePrice(side) : passivePrice(side);
+                const int volume = 1 + static_cast<int>(below(mConfig.max_volume));
+                const order::Id id = mNextId++;
+                mLive.push_back({id, symbol, side, price, volume});
+                return apply(OperationKind::insert, protocol::makeInsert(id, symbol, side, price, volume));
+            }
+
+            /*!
+            *  \brief Picks a random order that is still resting, nullptr if there is none.
+            */
+            LiveOrder* pickLive() {
+                while (!mLive.empty()) {
+                    const std::size_t index = below(mLive.size());
+                    if (mEngine.containsOrder(mLive[index].id)) return &mLive[index];
+                    mLive[index] = mLive.back();
+                    mLive.pop_back();
+                }
+                return nullptr;
+            }
+
+            Operation next() {
+                const double total = mConfig.insert_weight + mConfig.amend_weight + mConfig.pull_weight;
+                double pick = uniform() * total;
+                // Steer back towards the configured book size
+                if (mLive.size() < mConfig.resting_orders * 9 / 10) pick = 0;
+                if (mLive.size() > mConfig.resting_orders * 11 / 10) pick = total;
+
+                if (pick < mConfig.insert_weight) {
+                    return insert(uniform() < mConfig.aggressive_ratio);
+                }
+                LiveOrder* live = pickLive();
+                if (live == nullptr) return insert(false);
+                if (pick < mConfig.insert_weight + mConfig.amend_weight) {
+                    if (live->volume > 1 && below(2)) {
+                        // Smaller at the same price, keeps its priority
+                        live->volume /= 2;
+                    } else {
+                        live->price = passivePrice(live->side);
+                        live->volume = 1 + static_cast<int>(below(mConfig.max_volume));
+                    }
+                    return apply(OperationKind::amend, protocol::makeAmend(live->id, live->price, live->volume));
+                }
+                const order::Id id = live->id;
+                *live = mLive.back();
+                mLive.pop_back();
+                return apply(OperationKind::pull, protocol::makePull(id));
+            }
+    };
+}
+
+Workload generateWorkload(const WorkloadConfig& config) {
+    return Generator(config).run();
+}
+
+engine::EngineConfig engineConfigFor(const WorkloadConfig& config) {
+    engine::EngineConfig engine_config;
+    engine_config.max_open_orders = config.resting_orders + config.resting_orders / 4 + 1024;
+    // Aggressive leftovers can rest a few ticks through the mid
+    engine_config.levels_per_side = config.depth + 8;
+    // Room for both sides and some drift of the mid, the ticks match the generated prices
+    engine_config.book_type = config.book_type;
+    engine_config.ladder_levels = std::max<std::size_t>(1024, 4 * config.depth);
+    engine_config.tick_size = tick;
+    return engine_config;
+}
+
+} // bench namespace
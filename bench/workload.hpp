@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "matching_engine.hpp"
+#include "protocol.hpp"
+
+namespace bench {
+
+    /*! \brief Shape of the synthetic order flow.
+    *
+    * Every symbol trades around a fixed mid price. Passive orders rest a geometrically
+    * distributed number of ticks away from the touch, so most of the book sits near the top
+    * like in a real market, and aggressive orders cross a few ticks deep.
+    */
+    struct WorkloadConfig {
+        uint64_t seed = 42;
+        std::size_t symbols = 16;
+        // Orders resting in the books once the prefill is done, the mix keeps it around that
+        std::size_t resting_orders = 10000;
+        // Measured operations, after the prefill
+        std::size_t operations = 1000000;
+        // Price levels used on each side of every book
+        std::size_t depth = 50;
+        // Relative weights of the operations, inserts include the aggressive ones
+        double insert_weight = 0.5;
+        double amend_weight = 0.2;
+        double pull_weight = 0.3;
+        // Share of inserts that cross the spread
+        double aggressive_ratio = 0.1;
+        // Chance for a passive order to sit one tick further from the touch, in [0, 1)
+        double depth_decay = 0.9;
+        int max_volume = 100;
+        // Storage of the engine's books
+        engine::BookType book_type = engine::BookType::sorted;
+        // Levels per side the engine publishes to shared memory after every operation, 0 for none
+        std::size_t publish_depth = 0;
+    };
+
+    enum class OperationKind : uint8_t {
+        insert = 0,
+        amend = 1,
+        pull = 2,
+        match = 3
+    };
+
+    struct Operation {
+        OperationKind kind;
+        protocol::Message message;
+    };
+
+    /*! \brief A generated session: the orders that build the books, then the measured flow.
+    */
+    struct Workload {
+        std::vector<std::string> symbols;
+        std::vector<Operation> prefill;
+        std::vector<Operation> operations;
+    };
+
+    /*! \brief Builds a deterministic workload for a seed.
+    *
+    *   The flow is generated against a live MatchingEngine, so every AMEND and PULL targets
+    *   an order that is still resting when it is replayed on a fresh engine in the same order.
+    */
+    Workload generateWorkload(const WorkloadConfig& config);
+
+    /*! \brief Engine sizes that fit the workload without growing.
+    */
+    engine::EngineConfig engineConfigFor(const WorkloadConfig& config);
+
+} // bench namespace
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+#include "order.hpp"
+
+namespace engine {
+
+    // Values are part of the binary protocol, do not renumber
+    enum class CommandType : uint8_t {
+        invalid = 0,
+        insert = 1,
+        amend = 2,
+        pull = 3
+    };
+
+    /*! \brief One parsed input line.
+    *
+    * Plain data, filled in place by the parser. The symbol is a view into the input line,
+    * so the line has to outlive the command. Fields that the command type does not use are left untouched.
+    */
+    struct Command {
+        CommandType type;
+        order::Id id;
+        std::string_view symbol;
+        order::Side side;
+        order::Price price;
+        int volume;
+    };
+
+    // Why a command was refused. Values are reported to sinks and clients, do not renumber
+    enum class RejectCode : uint8_t {
+        // Accepted
+        none = 0,
+        // The command type is unknown, or a text line does not have its command's fields or a valid id
+        malformed = 1,
+        invalid_side = 2,
+        invalid_volume = 3,
+        // Binary INSERT for a symbol id that was never registered
+        unknown_symbol = 4,
+        // INSERT for an id that is still resting
+        duplicate_id = 5,
+        // AMEND or PULL for an id that is not resting, e.g. one that just got filled
+        unknown_order = 6,
+        // INSERT or AMEND at a price that is not positive or above order::max_price
+        invalid_price = 7,
+        // The attached journal could not be written, nothing is applied until it is replaced
+        journal_error = 8
+    };
+
+    /*!
+    *  \brief Short name of a reject code, as it appears in the text output.
+    */
+    inline const char* rejectReason(RejectCode code) {
+        switch (code) {
+            case RejectCode::none:
+                return "none";
+            case RejectCode::malformed:
+                return "malformed";
+            case RejectCode::invalid_side:
+                return "invalid_side";
+            case RejectCode::invalid_volume:
+                return "invalid_volume";
+            case RejectCode::unknown_symbol:
+                return "unknown_symbol";
+            case RejectCode::duplicate_id:
+                return "duplicate_id";
+            case RejectCode::unknown_order:
+                return "unknown_order";
+            case RejectCode::invalid_price:
+                return "invalid_price";
+            case RejectCode::journal_error:
+                return "journal_error";
+        }
+        return "unknown";
+    }
+
+} // engine namespace
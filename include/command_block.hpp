@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "command.hpp"
+#include "order.hpp"
+#include "protocol.hpp"
+#include "symbol_table.hpp"
+
+namespace engine {
+
+    /*! \brief How a batch of commands is matched.
+    */
+    enum class BatchMode : uint8_t {
+        // Every command is matched as it is applied, like processOrders()
+        continuous = 0,
+        // Commands only rest while the batch is applied, each book is uncrossed once at the end
+        auction = 1
+    };
+
+    /*! \brief A parsed batch of commands, stored as a structure of arrays.
+    *
+    * Each field has its own contiguous array, so applying a batch streams through memory
+    * instead of hopping between strings, and a command only pulls in the fields its type uses:
+    * a PULL reads its type and id, nothing else. Symbols are ids of the engine that parsed the batch.
+    */
+    struct CommandBlock {
+        std::vector<CommandType> types {};
+        std::vector<order::Id> ids {};
+        std::vector<SymbolId> symbols {};
+        std::vector<order::Side> sides {};
+        std::vector<order::Price> prices {};
+        std::vector<int32_t> volumes {};
+        // Why the parser refused the line, RejectCode::none for a command to apply
+        std::vector<RejectCode> rejects {};
+
+        std::size_t size() const { return types.size(); }
+
+        void reserve(std::size_t count) {
+            types.reserve(count);
+            ids.reserve(count);
+            symbols.reserve(count);
+            sides.reserve(count);
+            prices.reserve(count);
+            volumes.reserve(count);
+            rejects.reserve(count);
+        }
+
+        void clear() {
+            types.clear();
+            ids.clear();
+            symbols.clear();
+            sides.clear();
+            prices.clear();
+            volumes.clear();
+            rejects.clear();
+        }
+
+        void push_back(const protocol::Message& message) {
+            types.push_back(message.type);
+            ids.push_back(message.id);
+            symbols.push_back(message.symbol);
+            sides.push_back(message.side);
+            prices.push_back(message.price);
+            volumes.push_back(message.volume);
+            rejects.push_back(RejectCode::none);
+        }
+
+        /*!
+        *  \brief Keeps a line the parser refused in its place, so it is rejected in order with the rest.
+        */
+        void pushRejected(CommandType type, order::Id id, RejectCode code) {
+            push_back(protocol::makeInvalid(id));
+            types.back() = type;
+            rejects.back() = code;
+        }
+
+        /*!
+        *  \brief Puts one command back together as a binary message, e.g. to journal it.
+        */
+        protocol::Message message(std::size_t index) const {
+            return {types[index], sides[index], 0, symbols[index], ids[index], prices[index], volumes[index], 0};
+        }
+    };
+
+} // engine namespace
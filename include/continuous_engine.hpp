@@ -0,0 +1,185 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "matching_engine.hpp"
+#include "mpsc_queue.hpp"
+#include "protocol.hpp"
+#include "spsc_queue.hpp"
+#include "trade_sink.hpp"
+
+namespace engine {
+
+    /*! \brief What a gateway thread does when the ingress ring is full.
+    */
+    enum class Backpressure : uint8_t {
+        // Sleep until the sequencer frees a slot
+        block = 0,
+        // Busy-wait for a free slot, lowest latency but burns the core
+        spin = 1,
+        // Give up at once, submit() returns false
+        reject = 2
+    };
+
+    struct ContinuousConfig {
+        EngineConfig engine {};
+        // Commands waiting to be sequenced, shared by all gateway threads
+        std::size_t ingress_capacity = 4096;
+        // Execution reports waiting to be polled
+        std::size_t report_capacity = 4096;
+        Backpressure backpressure = Backpressure::block;
+        // Written to by the sequencer before each command is applied, see MatchingEngine::setJournal().
+        // It has to outlive the engine.
+        JournalWriter* journal = nullptr;
+    };
+
+    enum class ReportType : uint8_t {
+        trade = 0,
+        reject = 1
+    };
+
+    /*! \brief Outcome of a sequenced command, read from the outbound ring.
+    */
+    struct ExecutionReport {
+        ReportType type = ReportType::trade;
+        // Sequence number of the command that caused the report
+        order::Sequence sequence = 0;
+        // Order id of the rejected command, and why it was rejected, unused for trades
+        order::Id id = 0;
+        RejectCode reject = RejectCode::none;
+        // Filled for trades only
+        TradeEvent trade {};
+    };
+
+} // engine namespace
+
+
+/*! \brief Continuous-mode front end: gateway threads submit commands while matching runs on its own thread.
+ *
+ *  Gateways publish protocol::Messages into a bounded lock-free MPSC ring. A dedicated sequencer thread
+ *  pops them, stamps each one with the next sequence number and applies it to a MatchingEngine,
+ *  so the sequence is both the processing order and the time-priority key.
+ *  Trades and rejects go out through an SPSC ring that a single consumer thread polls.
+ *  With nothing to sequence, the sequencer spins for a short while and then sleeps until a gateway
+ *  submits a command, or until the journal is due for its group commit.
+ *
+ *  The symbol universe is fixed when the engine is built, so gateways can resolve symbol ids
+ *  without synchronizing with the sequencer.
+ */
+class ContinuousMatchingEngine {
+    public:
+        /*!
+        *  \brief Registers the symbols and starts the sequencer thread.
+        */
+        explicit ContinuousMatchingEngine(const std::vector<std::string>& symbols, const engine::ContinuousConfig& config = {});
+        ~ContinuousMatchingEngine();
+
+        ContinuousMatchingEngine(const ContinuousMatchingEngine&) = delete;
+        ContinuousMatchingEngine& operator=(const ContinuousMatchingEngine&) = delete;
+
+        /*!
+        *  \brief Id to use in messages for this symbol.
+        *
+        *   Safe to call from any thread.
+        *
+        *   \ret Returns false if the symbol was not given to the constructor.
+        */
+        bool findSymbol(std::string_view symbol, engine::SymbolId& id) const;
+
+        /*!
+        *  \brief Queues a message for the sequencer, from any number of gateway threads.
+        *
+        *   What happens when the ingress ring is full depends on the configured Backpressure.
+        *   Invalid messages are accepted here and come back as reject reports.
+        *
+        *   \ret Returns false only if the message was rejected because the ring was full.
+        */
+        bool submit(const protocol::Message& message);
+
+        /*!
+        *  \brief Takes the next execution report, from a single consumer thread.
+        *
+        *   Reports come out in sequence order. While the outbound ring is full the sequencer
+        *   stops taking commands and sleeps until a report is taken, so the consumer has to keep up,
+        *   stop() included.
+        *
+        *   \ret Returns false if no report is waiting.
+        */
+        bool pollReport(engine::ExecutionReport& report);
+
+        /*!
+        *  \brief Lets the sequencer apply everything already submitted, then joins it.
+        *
+        *   No submit() may be in flight or follow. Called by the destructor if needed.
+        */
+        void stop();
+
+        /*!
+        *  \brief Same as MatchingEngine::snapshot(). Only valid once stop() returned.
+        */
+        std::vector<std::string> snapshot() const;
+
+    private:
+        /*! \brief Turns the matcher's trades and rejects into reports on the outbound ring.
+        */
+        class ReportSink : public engine::TradeSink {
+            public:
+                explicit ReportSink(ContinuousMatchingEngine& owner) : mOwner(owner) {}
+                void onTrade(const engine::TradeEvent& trade) override;
+                void onReject(const engine::RejectEvent& reject) override;
+
+            private:
+                ContinuousMatchingEngine& mOwner;
+        };
+
+        engine::ContinuousConfig mConfig;
+        ReportSink mSink {*this};
+        MatchingEngine mEngine;
+        engine::MpscQueue<protocol::Message> mIngress;
+        engine::SpscQueue<engine::ExecutionReport> mReports;
+        // Only touched by the sequencer thread
+        order::Sequence mSequence = 0;
+
+        // Gateways waiting for room in the ingress ring, with Backpressure::block
+        std::atomic<int> mBlockedGateways {0};
+        std::mutex mBlockedMutex {};
+        std::condition_variable mNotFull {};
+
+        std::atomic<bool> mRunning {true};
+        std::thread mSequencer {};
+
+        // The sequencer sleeps here when it has nothing to do, or no room for a report. Its flag
+        // tells gateways and the consumer to take the mutex and wake it up, so a busy sequencer never does.
+        std::mutex mSequencerMutex {};
+        std::condition_variable mSequencerWakeup {};
+        std::atomic<bool> mSequencerParked {false};
+
+        /*!
+        *  \brief Sequencer loop, runs until stop() and the ingress ring is empty.
+        */
+        void run();
+
+        /*!
+        *  \brief Stamps the message and applies it, the sink reports what comes out of it.
+        */
+        void sequence(const protocol::Message& message);
+
+        void publish(const engine::ExecutionReport& report);
+
+        /*!
+        *  \brief Spins until `ready` holds, then sleeps until wakeSequencer() is called.
+        *
+        *   With `until_poll`, the sleep also ends when MatchingEngine::poll() is due.
+        */
+        template <typename Ready>
+        void await(Ready ready, bool until_poll);
+
+        void wakeSequencer();
+};
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "command.hpp"
+#include "order.hpp"
+
+namespace engine {
+
+#ifdef MATCHING_ENGINE_STATS
+    constexpr bool stats_enabled = true;
+#else
+    constexpr bool stats_enabled = false;
+#endif
+
+    /*! \brief Copy of a LogHistogram taken at one point in time.
+    */
+    struct HistogramSnapshot {
+        static constexpr std::size_t sub_buckets = 8;
+        // Enough octaves for any uint64_t value
+        static constexpr std::size_t bucket_count = 62 * sub_buckets;
+
+        std::array<uint64_t, bucket_count> counts {};
+
+        /*!
+        *  \brief Bucket a value is counted in. Below 8 each value has its own bucket, above that
+        *         every power of two is split in 8, so a bucket is at most 12.5% wide.
+        */
+        static std::size_t bucketFor(uint64_t value) {
+            if (value < sub_buckets) return static_cast<std::size_t>(value);
+            const std::size_t exponent = 63 - static_cast<std::size_t>(__builtin_clzll(value));
+            return (exponent - 2) * sub_buckets + ((value >> (exponent - 3)) & (sub_buckets - 1));
+        }
+
+        /*!
+        *  \brief Largest value counted in a bucket.
+        */
+        static uint64_t bucketHigh(std::size_t bucket) {
+            if (bucket < sub_buckets) return bucket;
+            const std::size_t exponent = bucket / sub_buckets + 2;
+            const uint64_t low = (sub_buckets + bucket % sub_buckets) << (exponent - 3);
+            return low + ((uint64_t(1) << (exponent - 3)) - 1);
+        }
+
+        uint64_t count() const {
+            uint64_t total = 0;
+            for (const auto bucket_count: counts) total += bucket_count;
+            return total;
+        }
+
+        /*!
+        *  \brief Upper bound of the values below which `fraction` of the samples fall, 0 if empty.
+        */
+        uint64_t percentile(double fraction) const {
+            const uint64_t total = count();
+            if (total == 0) return 0;
+            const auto rank = static_cast<uint64_t>(fraction * static_cast<double>(total - 1));
+            uint64_t seen = 0;
+            for (std::size_t bucket = 0; bucket < bucket_count; ++bucket) {
+                seen += counts[bucket];
+                if (seen > rank) return bucketHigh(bucket);
+            }
+            return bucketHigh(bucket_count - 1);
+        }
+    };
+
+    /*! \brief Log-bucketed histogram in the style of HdrHistogram, with a constant relative precision.
+    *
+    * Written by a single thread and readable from any other one: counts are relaxed atomics and a
+    * record is a plain load and store, no locked instruction.
+    */
+    class LogHistogram {
+        public:
+            LogHistogram() {
+                for (auto& bucket: mCounts) bucket.store(0, std::memory_order_relaxed);
+            }
+
+            void record(uint64_t value) {
+                auto& bucket = mCounts[HistogramSnapshot::bucketFor(value)];
+                bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+
+            HistogramSnapshot snapshot() const {
+                HistogramSnapshot result;
+                for (std::size_t bucket = 0; bucket < mCounts.size(); ++bucket) {
+                    result.counts[bucket] = mCounts[bucket].load(std::memory_order_relaxed);
+                }
+                return result;
+            }
+
+        private:
+            std::array<std::atomic<uint64_t>, HistogramSnapshot::bucket_count> mCounts;
+    };
+
+    /*! \brief Everything MatchingEngine::stats() reports. All zero when stats are compiled out.
+    */
+    struct EngineStatsSnapshot {
+        bool enabled = false;
+        uint64_t resting_orders = 0;
+        // Price levels across all books
+        uint64_t bid_levels = 0;
+        uint64_t ask_levels = 0;
+        // Every trade, continuous and auction ones
+        uint64_t fills = 0;
+        // Trades made while uncrossing a book at the end of an auction batch
+        uint64_t auction_fills = 0;
+        uint64_t cancels = 0;
+        uint64_t rejects = 0;
+        // Passes through the matching loop, including the one that finds nothing to cross
+        uint64_t match_iterations = 0;
+        // Nanoseconds spent applying INSERT, AMEND and PULL, indexed by latencyIndex()
+        std::array<HistogramSnapshot, 3> latency {};
+        // Trades caused by each order that matched or rested, outside auctions
+        HistogramSnapshot fills_per_aggressor {};
+        // Trades made by each book an auction uncrossed
+        HistogramSnapshot fills_per_uncross {};
+
+        static std::size_t latencyIndex(CommandType type) {
+            return static_cast<std::size_t>(type) - static_cast<std::size_t>(CommandType::insert);
+        }
+    };
+
+    /*! \brief Hooks the engine calls on its hot path.
+    *
+    * Only one of the two specializations is used, picked by MATCHING_ENGINE_STATS. The disabled one
+    * is empty and all its hooks are inline no-ops, so a build without stats does not even read the clock.
+    */
+    template <bool Enabled>
+    class StatsRecorder;
+
+    template <>
+    class StatsRecorder<false> {
+        public:
+            struct Timer {};
+
+            Timer startTimer() const { return {}; }
+            void recordLatency(CommandType, Timer) {}
+            void onRestingOrders(std::size_t) {}
+            void onLevelAdded(order::Side) {}
+            void onLevelRemoved(order::Side) {}
+            void onMatchIteration() {}
+            void onAggressorDone(uint64_t) {}
+            void onUncrossDone(uint64_t) {}
+            void onCancel() {}
+            void onReject() {}
+
+            EngineStatsSnapshot snapshot() const { return {}; }
+    };
+
+    template <>
+    class StatsRecorder<true> {
+        public:
+            using Timer = std::chrono::steady_clock::time_point;
+
+            Timer startTimer() const { return std::chrono::steady_clock::now(); }
+
+            void recordLatency(CommandType type, Timer start) {
+                const auto elapsed = std::chrono::steady_clock::now() - start;
+                mLatency[EngineStatsSnapshot::latencyIndex(type)].record(
+                    static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+            }
+
+            void onRestingOrders(std::size_t count) { mRestingOrders.store(count, std::memory_order_relaxed); }
+            void onLevelAdded(order::Side side) { add(levels(side), 1); }
+            void onLevelRemoved(order::Side side) { add(levels(side), uint64_t(-1)); }
+            void onMatchIteration() { add(mMatchIterations, 1); }
+
+            void onAggressorDone(uint64_t fills) {
+                add(mFills, fills);
+                mFillsPerAggressor.record(fills);
+            }
+
+            void onUncrossDone(uint64_t fills) {
+                add(mFills, fills);
+                add(mAuctionFills, fills);
+                mFillsPerUncross.record(fills);
+            }
+
+            void onCancel() { add(mCancels, 1); }
+            void onReject() { add(mRejects, 1); }
+
+            EngineStatsSnapshot snapshot() const {
+                EngineStatsSnapshot result;
+                result.enabled = true;
+                result.resting_orders = mRestingOrders.load(std::memory_order_relaxed);
+                result.bid_levels = mBidLevels.load(std::memory_order_relaxed);
+                result.ask_levels = mAskLevels.load(std::memory_order_relaxed);
+                result.fills = mFills.load(std::memory_order_relaxed);
+                result.auction_fills = mAuctionFills.load(std::memory_order_relaxed);
+                result.cancels = mCancels.load(std::memory_order_relaxed);
+                result.rejects = mRejects.load(std::memory_order_relaxed);
+                result.match_iterations = mMatchIterations.load(std::memory_order_relaxed);
+                for (std::size_t i = 0; i < mLatency.size(); ++i) {
+                    result.latency[i] = mLatency[i].snapshot();
+                }
+                result.fills_per_aggressor = mFillsPerAggressor.snapshot();
+                result.fills_per_uncross = mFillsPerUncross.snapshot();
+                return result;
+            }
+
+        private:
+            std::atomic<uint64_t> mRestingOrders {0};
+            std::atomic<uint64_t> mBidLevels {0};
+            std::atomic<uint64_t> mAskLevels {0};
+            std::atomic<uint64_t> mFills {0};
+            std::atomic<uint64_t> mAuctionFills {0};
+            std::atomic<uint64_t> mCancels {0};
+            std::atomic<uint64_t> mRejects {0};
+            std::atomic<uint64_t> mMatchIterations {0};
+            std::array<LogHistogram, 3> mLatency {};
+            LogHistogram mFillsPerAggressor {};
+            LogHistogram mFillsPerUncross {};
+
+            // Only the matching thread writes, so no read-modify-write instruction is needed
+            static void add(std::atomic<uint64_t>& counter, uint64_t value) {
+                counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+            }
+
+            std::atomic<uint64_t>& levels(order::Side side) {
+                return side == order::Side::buy ? mBidLevels : mAskLevels;
+            }
+    };
+
+    using EngineStats = StatsRecorder<stats_enabled>;
+
+} // engine namespace
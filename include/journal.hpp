@@ -0,0 +1,220 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "order.hpp"
+#include "protocol.hpp"
+#include "symbol_table.hpp"
+
+namespace engine {
+
+    enum class JournalRecordKind : uint32_t {
+        // A sequenced protocol::Message, as it was handed to the matcher
+        message = 1,
+        // A symbol registration, so that replayed messages resolve to the same ids
+        symbol = 2,
+        // The messages up to auction_end were applied as one auction batch, see BatchMode
+        auction_begin = 3,
+        auction_end = 4
+    };
+
+    /*! \brief Fixed header in front of every journal record, followed by `size` payload bytes.
+    *
+    * Message records carry the 32 byte protocol::Message. Symbol records carry the SymbolId
+    * followed by the name, and a zero sequence. Auction markers have no payload.
+    */
+    struct JournalRecordHeader {
+        JournalRecordKind kind;
+        uint32_t size;
+        order::Sequence sequence;
+    };
+
+    static_assert(sizeof(JournalRecordHeader) == 16, "Header layout is part of the journal format");
+
+    /*! \brief When buffered records are forced to disk.
+    *
+    * A commit writes the buffer out and fdatasync()s it, so that a batch of messages shares
+    * one sync. Whichever limit is reached first triggers it, a zero disables that limit.
+    */
+    struct JournalConfig {
+        // Records are written out, without syncing, when the buffer grows past this size
+        std::size_t buffer_size = 1 << 20;
+        // Commit every N messages
+        std::size_t sync_every_messages = 256;
+        // Commit once the oldest uncommitted message is this old, checked on append and on poll()
+        std::chrono::microseconds sync_interval {1000};
+    };
+
+    /*! \brief Append-only writer of the input journal.
+    *
+    * Records are staged in memory and reach the file in large writes, so journaling
+    * costs a copy per message until the group commit.
+    *
+    * The writer is fed from the matching path, so only commit() throws. A write or sync that
+    * fails anywhere else is recorded: from then on nothing is staged, append() returns false so
+    * the engine stops applying messages, and the next commit() reports the error.
+    */
+    class JournalWriter {
+        public:
+            /*!
+            *  \brief Opens the journal for appending, creating it if needed.
+            *
+            * \throws std::runtime_error if the file can not be opened.
+            */
+            explicit JournalWriter(const std::string& path, const JournalConfig& config = {});
+
+            /*!
+            *  \brief Commits whatever is still buffered.
+            */
+            ~JournalWriter();
+
+            JournalWriter(const JournalWriter&) = delete;
+            JournalWriter& operator=(const JournalWriter&) = delete;
+
+            /*!
+            *  \brief Stages a sequenced message, committing if a group commit limit was reached.
+            *
+            * \ret Returns false if the journal has failed, the message may then not be on disk.
+            */
+            bool append(order::Sequence sequence, const protocol::Message& message);
+
+            /*!
+            *  \brief Stages a symbol registration. It is committed along with the next messages.
+            */
+            void appendSymbol(SymbolId id, std::string_view symbol);
+
+            /*!
+            *  \brief Stages an auction_begin or auction_end marker.
+            */
+            void appendMarker(JournalRecordKind kind);
+
+            /*!
+            *  \brief Commits if the oldest uncommitted message has waited for sync_interval.
+            *
+            *   append() only looks at the clock when another message arrives, so the thread that
+            *   feeds the journal calls this while its input is idle to keep the interval promise.
+            *   A failure is recorded like in append(), for commit() to report.
+            */
+            void poll();
+
+            /*!
+            *  \brief When poll() will commit, for a thread that sleeps while its input is idle.
+            *
+            *   \ret Returns false if nothing waits for the interval, poll() has no work to do then.
+            */
+            bool commitDeadline(std::chrono::steady_clock::time_point& deadline) const;
+
+            /*!
+            *  \brief Writes out everything buffered and waits for it to be on disk.
+            *
+            * \throws std::runtime_error if writing or syncing fails now, or failed earlier.
+            */
+            void commit();
+
+            /*!
+            *  \brief True once a write or a sync failed.
+            */
+            bool failed() const { return mFailed; }
+
+            /*!
+            *  \brief Messages appended since the last commit.
+            */
+            std::size_t uncommitted() const { return mUncommitted; }
+
+            /*!
+            *  \brief Size the file will have once everything appended so far is written.
+            *
+            *   Recorded by snapshots, so that a replay can start right after them.
+            */
+            uint64_t offset() const { return mFileSize + mBuffer.size(); }
+
+        private:
+            int mFd = -1;
+            JournalConfig mConfig;
+            // Bytes already handed to the file
+            uint64_t mFileSize = 0;
+            std::vector<char> mBuffer {};
+            std::size_t mUncommitted = 0;
+            std::chrono::steady_clock::time_point mFirstUncommitted {};
+            bool mFailed = false;
+
+            void appendRecord(const JournalRecordHeader& header, const void* payload, std::size_t payload_size);
+            void appendBytes(const void* data, std::size_t size);
+            // Writes the buffer out once a record took it past buffer_size
+            void finishRecord();
+
+            /*!
+            *  \brief Hands the buffer to the file, and syncs it for a commit, recording a failure instead of throwing.
+            */
+            void writeBuffer();
+            void sync();
+    };
+
+    /*! \brief One record read back from a journal.
+    */
+    struct JournalEntry {
+        JournalRecordKind kind = JournalRecordKind::message;
+        order::Sequence sequence = 0;
+        protocol::Message message {};
+        // Set for symbol records, the view points into the reader
+        SymbolId symbol_id = 0;
+        std::string_view symbol {};
+    };
+
+    /*! \brief Reads a journal back, record by record.
+    *
+    * The file is mapped and read in place, the kernel reads ahead and drops the pages already
+    * replayed. A missing file reads as an empty journal. A record cut short by a crash ends the journal,
+    * validSize() then tells where the complete records stop.
+    */
+    class JournalReader {
+        public:
+            /*!
+            *  \brief Reads the journal from `offset` on, which has to be the start of a record.
+            *
+            * \throws std::runtime_error if the file exists but can not be read.
+            */
+            explicit JournalReader(const std::string& path, uint64_t offset = 0);
+
+            /*!
+            *  \brief Reads the next complete record.
+            *
+            * \throws std::runtime_error if the record is not one this reader wrote.
+            *
+            * \ret Returns false at the end of the journal.
+            */
+            bool next(JournalEntry& entry);
+
+            /*!
+            *  \brief Position in the file right after the last complete record read so far.
+            */
+            uint64_t validSize() const { return mStart + mOffset; }
+
+            uint64_t fileSize() const { return mStart + mData.size(); }
+
+        private:
+            std::unique_ptr<MappedFile> mFile {};
+            // Where in the file mData starts
+            uint64_t mStart = 0;
+            std::string_view mData {};
+            std::size_t mOffset = 0;
+    };
+
+    /*! \brief Outcome of MatchingEngine::replay().
+    */
+    struct ReplayResult {
+        // Sequence of the last message in the journal, 0 for an empty journal
+        order::Sequence last_sequence = 0;
+        // Messages fed to the matcher, the ones the engine already had are not counted
+        std::size_t messages = 0;
+        // Bytes of an incomplete last record that were cut off the file
+        std::size_t dropped_bytes = 0;
+    };
+
+} // engine namespace
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace engine {
+
+    /*! \brief Read-only memory mapping of a whole file, unmapped on destruction.
+    */
+    class MappedFile {
+        public:
+            enum class Access : uint8_t {
+                // Fault every page in up front, for files that are read all over
+                random = 0,
+                // Let the kernel read ahead and drop pages behind, for files read once from start to end
+                sequential = 1
+            };
+
+            /*!
+            * \throws std::runtime_error if the file can not be opened or mapped.
+            */
+            explicit MappedFile(const std::string& path, Access access = Access::random);
+            ~MappedFile();
+
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+
+            const char* data() const { return mData; }
+            std::size_t size() const { return mSize; }
+            std::string_view view() const { return {mData, mSize}; }
+
+        private:
+            const char* mData = nullptr;
+            std::size_t mSize = 0;
+    };
+
+} // engine namespace
@@ -1,24 +1,93 @@
 #pragma once
 
+#include <chrono>
 #include <vector>
 #include <string>
-#include <set>
+#include <string_view>
 #include <memory>
-#include <map>
+#include <limits>
 
+#include "command.hpp"
+#include "command_block.hpp"
+#include "engine_stats.hpp"
+#include "journal.hpp"
 #include "order.hpp"
+#include "order_book.hpp"
+#include "order_index.hpp"
+#include "order_pool.hpp"
+#include "protocol.hpp"
+#include "shared_book.hpp"
+#include "snapshot.hpp"
+#include "symbol_table.hpp"
+#include "trade_sink.hpp"
 
 namespace engine {
-    
-    /*! \brief Struct that holds all the buy and sell orders for a particular symbol.
+
+    // Books indexed by symbol id, nullptr until the first order for that symbol
+    using Clob = std::vector<std::unique_ptr<TradeNode>>;
+
+    /*! \brief Sizes the engine's preallocated storage.
     *
-    * Uses std::set instead of std::priority_queue here because the priority_queue lacks iteration.
+    * Going over these limits is allowed, it only costs allocations on the way.
     */
-    struct TradeNode {
-        TradeNode() = default;
-        
-        std::set<Order> buy_orders;
-        std::set<Order> sell_orders;
+    struct EngineConfig {
+        // Orders resting at the same time, across all symbols
+        std::size_t max_open_orders = 1024;
+        // Price levels reserved per side of every book
+        std::size_t levels_per_side = 64;
+        // How the books store their levels, see BookLayout
+        BookType book_type = BookType::sorted;
+        std::size_t ladder_levels = 1024;
+        order::Price tick_size = order::price_scale / 100;
+        // Send the levels each batch changed to the sink, see TradeSink::onLevelUpdate()
+        bool level_updates = false;
+    };
+
+    /*! \brief Aggregated depth of one symbol, best prices first.
+    */
+    struct BookDepth {
+        std::vector<DepthLevel> bids;
+        std::vector<DepthLevel> asks;
+    };
+
+    /*! \brief Best level on each side of one symbol. An empty side has no orders and a zero price.
+    */
+    struct TopOfBook {
+        DepthLevel bid {0, 0, 0};
+        DepthLevel ask {0, 0, 0};
+
+        bool hasBid() const { return bid.order_count != 0; }
+        bool hasAsk() const { return ask.order_count != 0; }
+
+        /*!
+        *  \brief Ask price minus bid price, only meaningful when both sides have orders.
+        */
+        order::Price spread() const { return ask.price - bid.price; }
+    };
+
+    /*! \brief Where a resting order lives, so it can be reached without searching the books.
+    */
+    struct OrderLocation {
+        TradeNode* node;
+        Order* order;
+    };
+
+    /*! \brief A level changed by the current batch, its update is sent once the batch is done.
+    */
+    struct ChangedLevel {
+        SymbolId symbol;
+        order::Side side;
+        order::Price price;
+    };
+
+    /*! \brief Copy of a resting order, as findOrder() reports it.
+    */
+    struct RestingOrder {
+        SymbolId symbol;
+        order::Side side;
+        order::Price price;
+        int volume;
+        OrderDetails details;
     };
     
 } // engine namespace
@@ -26,38 +95,290 @@ namespace engine {
 
 /*! \brief Class that represents a basic market and provides a matching engine.
  *
- *  It has one public method, processOrders(), which takes the string input, chops it into
- *  individual orders and adds them to the proper order queue. 
- *  Every time an order is added, deleted or modified it checks again for new possible trades.
+ *  processOrders() takes the string input, chops it into individual orders and adds them
+ *  to the proper order queue. processMessages() does the same for binary protocol::Messages,
+ *  the text commands are translated into those. 
+ *  Every time an order is added or modified it is matched against its own book before resting.
+ *
+ *  Commands that can not be applied are rejected with an engine::RejectCode, reported to the sink
+ *  next to the trades, and processing carries on: nothing on the command path throws.
+ *
+ *  With EngineConfig::level_updates, every level a batch changed is reported to the sink once the
+ *  batch is done, with its final totals. A batch is one call to processOrders(), processMessages(),
+ *  processBatch(), applyBatch() or replay(), or a single processMessage() call on its own.
  */
 class MatchingEngine {
     public:        
-        MatchingEngine() = default;
+        /*! 
+        *  \brief Trades are formatted and returned by processOrders(), ahead of the books.
+        */
+        explicit MatchingEngine(const engine::EngineConfig& config = {});
+
+        /*! 
+        *  \brief Trades are streamed to the sink as they happen, processOrders() only returns the books.
+        *
+        *   The sink has to outlive the engine.
+        */
+        explicit MatchingEngine(engine::TradeSink& sink, const engine::EngineConfig& config = {});
+
+        MatchingEngine(const MatchingEngine&) = delete;
+        MatchingEngine& operator=(const MatchingEngine&) = delete;
         
         /*! 
         *  \brief Takes the input argument, parses each line and calls the appropriate method for each command.
-        *  
-        * \throws std::runtime_error.
         *
-        * \ret Returns the output in the expected format
+        *   Lines that can not be parsed or applied are rejected and the next ones still run.
+        *
+        * \ret Returns the output in the expected format: the trades and rejects of this call, then a full snapshot().
+        *      The books are left untouched, so a following call carries on from the same state.
         */         
         std::vector<std::string> processOrders(const std::vector<std::string>& input);
+
+        /*! 
+        *  \brief Parses a whole buffer of newline separated commands, then applies them as one batch.
+        *
+        *   In continuous mode the result is the same as processOrders() on the same lines.
+        *   In auction mode orders only rest while the batch is applied, then every book that received
+        *   orders is uncrossed once, at a single price. Rejects are reported as the batch is applied.
+        *
+        * \ret Returns the output in the same format as processOrders()
+        */         
+        std::vector<std::string> processBatch(std::string_view input, engine::BatchMode mode = engine::BatchMode::continuous);
+
+        /*! 
+        *  \brief Parses newline separated commands into `block`, registering their symbols.
+        *
+        *   Empty lines are skipped. Malformed lines become invalid messages, rejected when the batch is applied.
+        */         
+        void parseBatch(std::string_view input, engine::CommandBlock& block);
+
+        /*! 
+        *  \brief Applies a parsed batch, trades and rejects go to the sink.
+        */         
+        void applyBatch(const engine::CommandBlock& block, engine::BatchMode mode);
+
+        /*! 
+        *  \brief Binary counterpart of processOrders(), takes a contiguous buffer of protocol::Message.
+        *
+        *   No text is parsed, messages are applied straight from the buffer.
+        *  
+        * \throws std::runtime_error if the buffer does not hold a whole number of messages.
+        *
+        * \ret Returns the output in the same format as processOrders()
+        */         
+        std::vector<std::string> processMessages(const char* data, std::size_t size);
+
+        /*! 
+        *  \brief Returns the id binary messages use for this symbol, registering it if needed.
+        *
+        *   The symbol is only listed in the output once an order was inserted for it.
+        */         
+        engine::SymbolId registerSymbol(std::string_view symbol);
+
+        /*! 
+        *  \brief Looks up the id of an already registered symbol, without registering it.
+        *
+        *   \ret Returns false if the symbol is unknown.
+        */         
+        bool findSymbol(std::string_view symbol, engine::SymbolId& id) const;
+
+        /*! 
+        *  \brief Validates a single binary message and calls the appropriate method for it.
+        *
+        *   Trades and the reject, if any, go to the sink, no output is built, so this is the entry
+        *   point for callers that stream messages in one at a time.
+        *
+        *   \ret Returns RejectCode::none if the message was applied.
+        */ 
+        engine::RejectCode processMessage(const protocol::Message& message);
+
+        /*! 
+        *  \brief Same as processMessage(), with the sequence number already stamped by a sequencer.
+        *
+        *   Sequence numbers order amends for time priority, so they have to keep increasing
+        *   from one call to the next. Rejected messages use up their sequence number too.
+        */ 
+        engine::RejectCode processMessage(const protocol::Message& message, order::Sequence sequence);
+
+        /*! 
+        *  \brief Same as processMessage(), for a command already parsed from text.
+        *
+        *   `parsed` is what utils::parseCommand() returned for the line. A line it refused is rejected
+        *   with that code, under the command's type and id as far as they could be read.
+        */ 
+        engine::RejectCode processCommand(const engine::Command& command,
+                                          engine::RejectCode parsed = engine::RejectCode::none);
+
+        /*! 
+        *  \brief Writes every message to the journal before it is applied, nullptr stops journaling.
+        *
+        *   The symbols registered so far are journaled right away, so the journal can be replayed
+        *   on its own. The journal has to outlive the engine, or be detached first.
+        *   Once the journal fails to write, messages are rejected with RejectCode::journal_error
+        *   instead of being applied unjournaled. JournalWriter::commit() reports the error.
+        */ 
+        void setJournal(engine::JournalWriter* journal);
+
+        /*! 
+        *  \brief Idle-time housekeeping, for the loop that feeds the engine to call when no input is waiting.
+        *
+        *   Commits the journal once its oldest uncommitted message is older than JournalConfig::sync_interval,
+        *   which would otherwise wait for the next message to arrive.
+        */ 
+        void poll();
+
+        /*! 
+        *  \brief Latest time poll() should be called by, for a loop that sleeps while idle.
+        *
+        *   \ret Returns false if poll() has nothing waiting, the loop can sleep until input arrives.
+        */ 
+        bool pollDeadline(std::chrono::steady_clock::time_point& deadline) const;
+
+        /*!
+        *  \brief Writes the top levels of every book to shared memory after each batch, nullptr stops it.
+        *
+        *   Only the books a batch changed are written again, on the matching thread and without
+        *   syscalls. The books listed so far are written right away. The publisher has to outlive
+        *   the engine, or be detached first.
+        */
+        void setBookPublisher(engine::SharedBookPublisher* publisher);
+
+        /*! 
+        *  \brief Rebuilds the state by feeding a journal back through the matcher.
+        *
+        *   Meant for a fresh engine, before a journal is attached. Messages that were rejected when
+        *   they were journaled are rejected again, trades and rejects go to the sink as they did
+        *   the first time. An incomplete last record, left by a crash, is cut off the file so that
+        *   a JournalWriter can carry on after the last complete one.
+        *   Messages the engine already applied, e.g. from a snapshot, are skipped.
+        *   Later messages continue from the last replayed sequence.
+        *  
+        * \throws std::runtime_error if the journal is corrupt.
+        */ 
+        engine::ReplayResult replay(const std::string& journal_path, uint64_t journal_offset = 0);
+
+        /*! 
+        *  \brief Writes every book, the order index and the symbol table to a flat snapshot file.
+        *
+        *   The attached journal, if any, is committed first and its size recorded, so that a restart
+        *   only replays what comes after. The file is written next to `path` and renamed over it,
+        *   so a crash never leaves a half-written snapshot behind.
+        *  
+        * \throws std::runtime_error if the file can not be written.
+        */ 
+        void writeSnapshot(const std::string& path);
+
+        /*! 
+        *  \brief Restores a fresh engine from a snapshot file.
+        *
+        *   The file is memory-mapped and walked once, so the cost depends on how many orders
+        *   were resting, not on how long the session was. Follow up with
+        *   replay(journal_path, info.journal_offset) to apply what happened after the snapshot.
+        *  
+        * \throws std::runtime_error if the engine is not fresh or the file is not a valid snapshot.
+        */ 
+        engine::SnapshotInfo loadSnapshot(const std::string& path);
+
+        /*! 
+        *  \brief True if an order with this id is resting in any book.
+        */ 
+        bool containsOrder(order::Id id) const;
+
+        /*! 
+        *  \brief Reads a resting order, details included, without changing it.
+        *
+        *   \ret Returns false if no order with this id is resting.
+        */ 
+        bool findOrder(order::Id id, engine::RestingOrder& out) const;
+
+        /*! 
+        *  \brief Reads the latency histograms and counters.
+        *
+        *   Safe to call from another thread while the engine is matching; the values are read one
+        *   by one, so they may be a few events apart. Everything is zero, and `enabled` false,
+        *   unless the engine was built with MATCHING_ENGINE_STATS.
+        */ 
+        engine::EngineStatsSnapshot stats() const;
+
+        /*! 
+        *  \brief Reads the aggregated depth of one symbol, up to `max_levels` per side, without changing the book.
+        *
+        *   Levels keep their totals up to date, so this costs O(max_levels) whatever the number of orders.
+        *   The vectors in `out` are reused, so polling does not allocate once they are large enough.
+        *
+        *   \ret Returns false if nothing was ever inserted for this symbol.
+        */         
+        bool depth(std::string_view symbol, std::size_t max_levels, engine::BookDepth& out) const;
+        bool depth(engine::SymbolId symbol, std::size_t max_levels, engine::BookDepth& out) const;
+
+        /*!
+        *  \brief Reads the best bid and ask of one symbol in constant time, without changing the book.
+        *
+        *   Like every other query, it has to run on the thread that feeds the engine.
+        *
+        *   \ret Returns false if nothing was ever inserted for this symbol.
+        */
+        bool topOfBook(std::string_view symbol, engine::TopOfBook& out) const;
+        bool topOfBook(engine::SymbolId symbol, engine::TopOfBook& out) const;
+
+        /*! 
+        *  \brief Formats the depth of every symbol in alphabetical order, without changing the books.
+        *
+        *   Each symbol gets a "===SYMBOL===" line followed by "bid_price,bid_volume,ask_price,ask_volume"
+        *   rows, at most `max_levels` of them.
+        */         
+        std::vector<std::string> snapshot(std::size_t max_levels = std::numeric_limits<std::size_t>::max()) const;
+
+        /*! 
+        *  \brief Names of the symbols that appear in snapshot(), in alphabetical order.
+        */         
+        std::vector<std::string_view> listedSymbols() const;
+
+        /*! 
+        *  \brief Appends the snapshot() block of a single symbol, nothing if it is not listed.
+        */         
+        void appendBook(std::string_view symbol, std::size_t max_levels, std::vector<std::string>& result) const;
     
     private:
-        // We could use unordered_map but it needs to be in alphabetical order
-        std::map<std::string, std::unique_ptr<engine::TradeNode>> mClob {};
-        std::vector<std::string> mListOfTrades {};
-        std::set<order::Id> mActiveOrderIds;
+        engine::EngineConfig mConfig;
+        engine::OrderPool mOrderPool;
+        engine::SymbolTable mSymbols {};
+        engine::Clob mClob {};
+        engine::StringSink mStringSink {};
+        engine::TradeSink* mSink = &mStringSink;
+        // Every resting order, by id
+        engine::OrderIdMap<engine::OrderLocation> mOrderIndex;
+        // Sequence of the message being applied
+        order::Sequence mSequence = 0;
+        engine::JournalWriter* mJournal = nullptr;
+        engine::EngineStats mStats {};
+        // Set while an auction batch is applied: orders rest without matching
+        bool mDeferMatching = false;
+        // Books that received orders during the auction batch
+        std::vector<engine::TradeNode*> mPendingUncross {};
+        // Levels to report once the outermost batch is done, when level updates are on
+        std::vector<engine::ChangedLevel> mChangedLevels {};
+        uint32_t mBatchDepth = 0;
+        engine::SharedBookPublisher* mPublisher = nullptr;
+        // Books to write to the publisher once the outermost batch is done
+        std::vector<engine::TradeNode*> mChangedBooks {};
         
         /*! 
         *  \brief Add a buy or sell order in the market.
         */
-        void addOrder(const std::string& symbol, Order);
+        void addOrder(engine::SymbolId symbol, const Order&);
+
+        /*!
+        *  \brief Storage of the books, from the config.
+        */
+        engine::BookLayout bookLayout() const {
+            return {mConfig.book_type, mConfig.levels_per_side, mConfig.ladder_levels, mConfig.tick_size};
+        }
 
         /*! 
         *  \brief Remove a buy or sell order from the market.
         */
-        void pullOrder(order::Id);
+        engine::RejectCode pullOrder(order::Id);
         
         /*! 
         *  \brief Modify the price or volume of an existing order.
@@ -65,46 +386,119 @@ class MatchingEngine {
         *   If the price is modified, or the volume increased, then the order
         *   will lose it's time priority.
         *
+        *   \ret Returns why the command was refused, before anything changed, or RejectCode::none.
         */        
-        void amendOrder(order::Id, double price, int volume); 
+        engine::RejectCode amendOrder(order::Id, order::Price price, int volume); 
 
         /*! 
         *  \brief Modify the price or volume of an either buy or sell existing order.
-        *
-        *   \ret Returns false if no order with that id was found, true otherwise.
         */
-        bool amend(std::set<Order>& order_set, const std::string& symbol, order::Id id, double price, int volume);
+        void amend(const engine::OrderLocation& location, order::Price price, int volume);
+
+        /*! 
+        *  \brief Rest an order in its book, or take it out, keeping the level counters up to date.
+        */
+        void linkOrder(engine::TradeNode& node, Order* order);
+        void unlinkOrder(engine::TradeNode& node, Order* order);
+        template <order::Side Side>
+        void linkOrder(engine::TradeNode& node, Order* order);
+        template <order::Side Side>
+        void unlinkOrder(engine::TradeNode& node, Order* order);
+
+        /*!
+        *  \brief Takes `filled` off a resting order's volume, and off its level.
+        */
+        template <order::Side Side>
+        void reduceOrder(engine::TradeNode& node, Order* order, int filled);
+
+        /*!
+        *  \brief Records that a level of the book changed, for level updates and the shared memory publisher.
+        */
+        template <order::Side Side>
+        void levelChanged(engine::TradeNode& node, order::Price price);
+
+        /*!
+        *  \brief Sends one update per level changed since the last call, and writes the books they belong
+        *          to to the shared memory publisher, unless a batch is still going on.
+        */
+        void publishChanges();
+
+        /*! 
+        *  \brief Remove a resting order from its book and from the order index.
+        */
+        void eraseOrder(engine::OrderLocation location);
+        template <order::Side Side>
+        void eraseOrder(engine::OrderLocation location);
         
         /*! 
         *  \brief Matching engine.
         *
-        *   Iterates over all the existing symbols and looks if any trade can happen.
-        *   A trade happens when the top of the buy stack and bottom of the sell stack match in price.
-        *   Buy and sell stacks are always ordered by price and timestamp.
-        *   When a match happens the volumes are updated accordingly, and for the orders that has been
-        *   fulfilled the stack is popped.
+        *   Matches an order that just arrived, or lost its priority, against the opposite side of
+        *   its own book only, then rests whatever is left of it.
+        *   A trade happens as long as the order's price crosses the best price on the other side.
+        *   Each price level is a FIFO queue, so the oldest order at the best price trades first.
+        *   Orders that have been fulfilled are removed from their level and from the index.
         *
-        *   This function would be a candidate for adding to it's own thread.
+        *   The book is never left crossed, so no other symbol needs to be looked at and the cost
+        *   of an event does not depend on how many symbols are listed.
         */
-        void processCurrentOrders();
+        void matchOrder(engine::TradeNode& node, Order* incoming_order);
+
+        /*! 
+        *  \brief The matching loop of matchOrder(), for an incoming order of a known side.
+        */
+        template <order::Side Side>
+        void matchIncoming(engine::TradeNode& node, Order* incoming_order);
         
         /*! 
-        *  \brief When a trade took place, it adds it to the list of trades.
+        *  \brief Starts and ends an auction batch, uncrossing the books it touched at the end.
+        */
+        void beginAuction();
+        void endAuction();
+
+        /*! 
+        *  \brief Matches a crossed book at a single clearing price.
+        *
+        *   The price is the level price that executes the most volume, then leaves the smallest
+        *   surplus on either side, then the lowest one. Orders fill in price then time priority
+        *   up to that volume, which always leaves the book uncrossed.
+        */
+        void uncross(engine::TradeNode& node);
+
+        /*! 
+        *  \brief When a trade took place, it reports it to the sink.
         */    
-        void addTradeToHistory(const std::string& symbol, double price, int volume , order::Id agressive_id, order::Id passive_id);
+        void addTradeToHistory(const engine::TradeNode& node, order::Price price, int volume , order::Id agressive_id, order::Id passive_id);
         std::vector<std::string> getFinalResult();
+        void appendSnapshot(std::vector<std::string>& result, std::size_t max_levels) const;
         
         /*! 
-        *  \brief Takes string arguments from the input, creates an Order and calls addOrder on it.
-        *  
-        * \throws std::runtime_error.
+        *  \brief Translates a parsed text command into its binary message, interning the symbol.
         */ 
-        void insert_order(const std::vector<std::string>&);
-        
+        protocol::Message toMessage(const engine::Command&);
+
         /*! 
-        *  \brief Takes string arguments from the input and calls amendOrder.
-        *  
-        * \throws std::runtime_error.
+        *  \brief Takes the fields of an INSERT, creates an Order and calls addOrder on it.
+        *
+        *   \ret Returns why the command was refused, before anything changed, or RejectCode::none.
+        */ 
+        engine::RejectCode insert_order(order::Id id, engine::SymbolId symbol, order::Side side, order::Price price, int volume);
+
+        /*! 
+        *  \brief Same as processMessage(), for one row of a parsed batch.
+        *
+        *   Only the columns the command type uses are read, a message is only put together for the journal.
+        */ 
+        engine::RejectCode applyCommand(const engine::CommandBlock& block, std::size_t index);
+
+        /*! 
+        *  \brief Rejects a line the parser refused, journaling it as an invalid message so it keeps its sequence number.
+        */ 
+        engine::RejectCode rejectUnparsed(engine::CommandType type, order::Id id, engine::RejectCode code);
+
+        /*! 
+        *  \brief Records the outcome of a command: its latency if it was applied, the reject otherwise.
         */ 
-        void amend_order(const std::vector<std::string>&);
+        engine::RejectCode completeCommand(engine::CommandType type, order::Id id, engine::RejectCode result,
+                                           engine::EngineStats::Timer timer);
 };
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace engine {
+
+    /*! \brief Bounded lock-free ring buffer for any number of producer threads and one consumer thread.
+    *
+    * Capacity is rounded up to a power of two. Every cell carries its own sequence number:
+    * producers claim a position with a compare-and-swap on the tail, fill the cell, then publish it
+    * by bumping the cell's sequence, so the consumer never sees a half-written value.
+    */
+    template <typename T>
+    class MpscQueue {
+        public:
+            explicit MpscQueue(std::size_t capacity) {
+                std::size_t size = 2;
+                while (size < capacity) size *= 2;
+                mCells.reset(new Cell[size]);
+                mMask = size - 1;
+                for (std::size_t i = 0; i < size; ++i) {
+                    mCells[i].sequence.store(i, std::memory_order_relaxed);
+                }
+            }
+
+            MpscQueue(const MpscQueue&) = delete;
+            MpscQueue& operator=(const MpscQueue&) = delete;
+
+            /*!
+            *  \brief Producer side, safe to call from several threads at once.
+            *
+            *   \ret Returns false if the ring is full, nothing is written then.
+            */
+            bool tryPush(const T& value) {
+                std::size_t tail = mTail.load(std::memory_order_relaxed);
+                while (true) {
+                    Cell& cell = mCells[tail & mMask];
+                    const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                    const auto lag = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(tail);
+                    if (lag == 0) {
+                        if (mTail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed)) {
+                            cell.value = value;
+                            cell.sequence.store(tail + 1, std::memory_order_release);
+                            return true;
+                        }
+                    } else if (lag < 0) {
+                        // The consumer has not freed this cell yet
+                        return false;
+                    } else {
+                        // Another producer took this position
+                        tail = mTail.load(std::memory_order_relaxed);
+                    }
+                }
+            }
+
+            /*!
+            *  \brief Consumer side.
+            *
+            *   \ret Returns false if the ring is empty, `value` is left untouched then.
+            */
+            bool tryPop(T& value) {
+                Cell& cell = mCells[mHead & mMask];
+                if (cell.sequence.load(std::memory_order_acquire) != mHead + 1) return false;
+                value = cell.value;
+                // Hand the cell back to the producers for the next lap
+                cell.sequence.store(mHead + mMask + 1, std::memory_order_release);
+                ++mHead;
+                return true;
+            }
+
+            /*!
+            *  \brief Consumer side. True if tryPop() would find nothing right now.
+            */
+            bool empty() const {
+                return mCells[mHead & mMask].sequence.load(std::memory_order_acquire) != mHead + 1;
+            }
+
+            std::size_t capacity() const { return mMask + 1; }
+
+        private:
+            struct Cell {
+                std::atomic<std::size_t> sequence {0};
+                T value {};
+            };
+
+            std::unique_ptr<Cell[]> mCells {};
+            std::size_t mMask = 0;
+
+            // Next position to claim, shared by the producers
+            alignas(64) std::atomic<std::size_t> mTail {0};
+
+            // Only touched by the consumer
+            alignas(64) std::size_t mHead = 0;
+    };
+
+} // engine namespace
@@ -1,50 +1,89 @@
 #pragma once
 
 #include <cstdint>
-#include <ctime>
+#include <limits>
 #include <string>
 
 namespace order {
 
-enum class Side {
-    buy,
-    sell
+enum class Side : uint8_t {
+    buy = 0,
+    sell = 1
 };
 
 using Id = uint64_t;
+
+/*! \brief Position of a command in the engine's input, stamped as it is applied.
+*
+* Strictly increasing, so it orders events without looking at the wall clock.
+*/
+using Sequence = uint64_t;
+
+/*! \brief Fixed-point price, in ticks of 1/price_scale.
+*
+* Four implied decimals, the most precision an input price may have.
+*/
+using Price = int64_t;
+
+constexpr Price price_scale = 10000;
+
+// Highest price an order may have, a billion in whole units, so sums and differences of prices never overflow
+constexpr Price max_price = 1000000000 * price_scale;
+
+/*! \brief True if an order may rest at `price`: strictly positive and at most max_price.
+*/
+constexpr bool isValidPrice(Price price) {
+    return price > 0 && price <= max_price;
+}
     
 } // order namespace
 
 /*! \brief Struct that represents a buy or sell order in the market.
  *
- *  Id's are provided, and timestamps are generated if not provided.
+ *  Id's are provided. Time priority is given by the position of the order in its price level
+ *  queue, so no timestamp is needed for ordering.
+ *
+ *  Only what matching reads is kept here, and each order takes exactly one cache line, so walking
+ *  a deep level costs one line per order filled. Everything else lives in its OrderDetails.
  */
-struct Order {
+struct alignas(64) Order {
     /* 
-    *  \brief Main constructor. Creates a timestamp and last_updated is intitialized with 0.
+    *  \brief Main constructor. last_updated is intitialized with 0.
     */
-    Order(order::Id, order::Side, double limit_price, int volume);
-
-    /* 
-    *  \brief Custom timestamp constructor. last_updated is intitialized with 0. 
-    *         Used to amend an order without losing time priority. 
-    */
-    Order(order::Id, order::Side, double limit_price, int volume, std::time_t timestamp);
+    Order(order::Id, order::Side, order::Price limit_price, int volume);
     
     /* 
-    *  \brief Custom timestamp and last_updated timestamp constructor. 
+    *  \brief Custom last_updated sequence constructor. 
     *         Used to amend an order. 
     */
-    Order(order::Id id, order::Side side, double limit_price, int volume, std::time_t timestamp, std::time_t amend_ts);
-    
-    bool operator<(const Order& other) const;
-    bool operator==(const Order& other) const;
-    bool operator!=(const Order& other) const;
+    Order(order::Id id, order::Side side, order::Price limit_price, int volume, order::Sequence amend_sequence);
             
+    order::Price price;
+    // Sequence of the last amend that cost the order its priority, 0 if there was none
+    order::Sequence last_updated;
     order::Id id;
-    order::Side side;
-    double price;
+
+    // Intrusive links of the price level queue this order rests in
+    Order* prev = nullptr;
+    Order* next = nullptr;
+
     int volume;
-    std::time_t timestamp;
-    std::time_t last_updated;
+    // Where the OrderPool keeps this order's details, set by the pool
+    uint32_t pool_index = 0;
+    order::Side side;
+};
+
+static_assert(sizeof(Order) == 64 && alignof(Order) == 64, "An order has to fill exactly one cache line");
+
+/*! \brief The fields of an order that matching never reads.
+ *
+ *  Kept in an array parallel to the orders, so they do not take cache space on the fill path.
+ */
+struct OrderDetails {
+    // Volume the order was inserted with
+    int original_volume = 0;
+    // Sequence of the INSERT that created the order
+    order::Sequence entered = 0;
+    // Sequence of the last amend, whether it kept the order's priority or not, 0 if there was none
+    order::Sequence amended = 0;
 };
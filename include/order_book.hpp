@@ -0,0 +1,293 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "order.hpp"
+#include "symbol_table.hpp"
+
+namespace engine {
+
+    /*! \brief All the orders resting at one price, in time priority.
+    *
+    * The queue is intrusive: orders link to each other through their prev/next pointers,
+    * so appending, unlinking and filling an order never allocates.
+    * The level keeps the total volume and the number of its orders up to date, so reading
+    * the depth never walks the queue.
+    */
+    struct PriceLevel {
+        explicit PriceLevel(order::Price level_price) : price(level_price) {}
+
+        /*!
+        *  \brief Appends the order at the back of the queue, it will be the last one to fill.
+        */
+        void push_back(Order* order);
+
+        /*!
+        *  \brief Removes the order from the queue, wherever it is.
+        */
+        void unlink(Order* order);
+
+        /*!
+        *  \brief Takes `filled` off the volume of one of the level's orders.
+        */
+        void reduce(Order* order, int filled) {
+            order->volume -= filled;
+            volume -= filled;
+        }
+
+        bool empty() const { return head == nullptr; }
+
+        order::Price price;
+        Order* head = nullptr;
+        Order* tail = nullptr;
+        // Sum of the volumes of the orders in the queue
+        int64_t volume = 0;
+        uint32_t order_count = 0;
+    };
+
+    /*! \brief Aggregated volume resting at one price.
+    */
+    struct DepthLevel {
+        order::Price price;
+        int64_t volume;
+        uint32_t order_count = 0;
+    };
+
+    /*! \brief Price ordering of one side of the book, fixed at compile time.
+    */
+    template <order::Side Side>
+    struct SideTraits {
+        static constexpr order::Side opposite = Side == order::Side::buy ? order::Side::sell : order::Side::buy;
+
+        /*!
+        *  \brief True if `price` is a worse price than `other` for this side.
+        */
+        static constexpr bool worse(order::Price price, order::Price other) {
+            if constexpr (Side == order::Side::buy) {
+                return price < other;
+            } else {
+                return price > other;
+            }
+        }
+
+        /*!
+        *  \brief True if an order of this side at `price` trades with a resting order of the other side at `resting`.
+        */
+        static constexpr bool crosses(order::Price price, order::Price resting) {
+            if constexpr (Side == order::Side::buy) {
+                return price >= resting;
+            } else {
+                return price <= resting;
+            }
+        }
+    };
+
+    /*! \brief How each side of a book stores its price levels.
+    */
+    enum class BookType : uint8_t {
+        // Sorted vector of levels, any price, searched by binary search
+        sorted = 0,
+        // Array of levels, one per tick around a sliding base, with occupancy bitmaps to find the
+        // best and the next levels. Prices outside the band or off the tick grid use the sorted vector.
+        ladder = 1
+    };
+
+    /*! \brief Storage of one book side.
+    */
+    struct BookLayout {
+        BookType type = BookType::sorted;
+        // Levels reserved in the sorted vector
+        std::size_t reserved_levels = 64;
+        // Ladder only: levels in the band, rounded up to a multiple of 64
+        std::size_t ladder_levels = 1024;
+        // Ladder only: price distance between two adjacent levels of the band
+        order::Price tick_size = order::price_scale / 100;
+    };
+
+    /*! \brief One side (bids or asks) of a symbol's book.
+    *
+    *  Levels are kept in a sorted vector with the best price at the back, so the top of the book
+    *  is the last element and levels near the touch are cheap to add and remove.
+    *  The side does not own the orders, it only links them in.
+    *
+    *  With a ladder layout, prices on the tick grid inside a band of `ladder_levels` ticks live in a
+    *  flat array indexed by their distance to the band's base instead, so finding a level is one
+    *  division. A bit per level, and a summary bit per 64 levels, point at the occupied ones: the best
+    *  level and the next one are found with a couple of clz/ctz. The band slides with the market: a price
+    *  on the grid that does not fit is centred on when it would be the best one on the side, or when the
+    *  band is empty, and a band whose last level goes moves onto the best sorted level if it is on the grid.
+    *  Levels the moved band leaves out go to the sorted vector, the ones it now covers come over from it.
+    *
+    *  The side is a template parameter, so level searches compare prices without checking
+    *  which side they are on.
+    */
+    template <order::Side Side>
+    class BookSide {
+        public:
+            using Traits = SideTraits<Side>;
+            static constexpr order::Side side = Side;
+
+            explicit BookSide(const BookLayout& layout);
+
+            /*!
+            *  \brief Adds the order at the back of the queue for its price, creating the level if needed.
+            *
+            *   \ret Returns true if a level was created.
+            */
+            bool insert(Order* order);
+
+            /*!
+            *  \brief Removes the order from its level, dropping the level if it became empty.
+            *
+            *   \ret Returns true if a level was dropped.
+            */
+            bool erase(Order* order);
+
+            /*!
+            *  \brief Takes `filled` off a resting order's volume, and off its level's total.
+            *
+            *   The order stays in place, even if nothing is left of it.
+            */
+            void reduce(Order* order, int filled);
+
+            /*!
+            *  \brief Level at `price`, nullptr if there is none.
+            */
+            const PriceLevel* level(order::Price price) const;
+
+            /*!
+            *  \brief Level with the best price, nullptr if the side is empty.
+            */
+            const PriceLevel* bestLevel() const {
+                const PriceLevel* sparse = mLevels.empty() ? nullptr : &mLevels.back();
+                if (mLadderCount == 0) return sparse;
+                const PriceLevel* ladder = &mLadder[firstLadderLevel()];
+                return sparse && Traits::worse(ladder->price, sparse->price) ? sparse : ladder;
+            }
+
+            /*!
+            *  \brief Oldest order at the best price, nullptr if the side is empty.
+            */
+            Order* best() const {
+                const PriceLevel* level = bestLevel();
+                return level ? level->head : nullptr;
+            }
+
+            /*!
+            *  \brief Best price on this side, the side must not be empty.
+            */
+            order::Price bestPrice() const { return bestLevel()->price; }
+
+            bool empty() const { return mLevels.empty() && mLadderCount == 0; }
+
+            /*!
+            *  \brief True if a level at `price` lives on the ladder rather than in the sorted vector.
+            */
+            bool inLadder(order::Price price) const { return ladderIndex(price) != no_level; }
+
+            /*!
+            *  \brief Appends up to `max_levels` aggregated levels to `out`, best price first, in O(max_levels).
+            */
+            void depth(std::size_t max_levels, std::vector<DepthLevel>& out) const;
+
+            /*!
+            *  \brief Calls `visit` on every level from the best price to the worst one, until it returns false.
+            */
+            template <typename Visitor>
+            void forEachLevel(Visitor&& visit) const {
+                auto sparse = mLevels.rbegin();
+                std::size_t index = mLadderCount == 0 ? no_level : firstLadderLevel();
+                while (index != no_level || sparse != mLevels.rend()) {
+                    const PriceLevel* level;
+                    if (index != no_level && (sparse == mLevels.rend() || Traits::worse(sparse->price, mLadder[index].price))) {
+                        level = &mLadder[index];
+                        index = nextLadderLevel(index);
+                    } else {
+                        level = &*sparse;
+                        ++sparse;
+                    }
+                    if (!visit(*level)) return;
+                }
+            }
+
+        private:
+            static constexpr std::size_t no_level = static_cast<std::size_t>(-1);
+
+            // Levels outside the ladder, best price at the back
+            std::vector<PriceLevel> mLevels {};
+            // Level i of the band is at price mBase + i * mTick, only meaningful while it is occupied
+            std::vector<PriceLevel> mLadder {};
+            // A bit per ladder level, set while it has orders
+            std::vector<uint64_t> mOccupied {};
+            // A bit per word of mOccupied, set while that word is not zero
+            std::vector<uint64_t> mSummary {};
+            order::Price mBase = 0;
+            order::Price mTick = 1;
+            std::size_t mLadderCount = 0;
+
+            /*!
+            *  \brief Ladder index of `price`, no_level if it is outside the band or off the tick grid.
+            */
+            std::size_t ladderIndex(order::Price price) const {
+                if (mLadder.empty() || price < mBase) return no_level;
+                // Unsigned, the distance between two extreme prices does not fit in a Price
+                const uint64_t offset = static_cast<uint64_t>(price) - static_cast<uint64_t>(mBase);
+                const uint64_t index = offset / static_cast<uint64_t>(mTick);
+                if (index * static_cast<uint64_t>(mTick) != offset || index >= mLadder.size()) return no_level;
+                return static_cast<std::size_t>(index);
+            }
+
+            // Best occupied ladder level, there must be one
+            std::size_t firstLadderLevel() const;
+            // Next occupied ladder level worse than `index`, no_level if there is none
+            std::size_t nextLadderLevel(std::size_t index) const;
+            // Highest occupied level below `limit` and lowest one from `start`
+            std::size_t highestLadderLevel(std::size_t limit) const;
+            std::size_t lowestLadderLevel(std::size_t start) const;
+
+            void markLevel(std::size_t index);
+            void clearLevel(std::size_t index);
+            void recentre(order::Price price);
+
+            std::vector<PriceLevel>::iterator findLevel(order::Price price);
+    };
+
+    extern template class BookSide<order::Side::buy>;
+    extern template class BookSide<order::Side::sell>;
+
+    using BidSide = BookSide<order::Side::buy>;
+    using AskSide = BookSide<order::Side::sell>;
+
+    /*! \brief Struct that holds all the buy and sell orders for a particular symbol.
+    *
+    * The orders themselves live in the engine's OrderPool.
+    */
+    struct TradeNode {
+        TradeNode(SymbolId symbol, const BookLayout& layout)
+            : symbol_id(symbol)
+            , buy_orders(layout)
+            , sell_orders(layout)
+        {}
+        TradeNode(const TradeNode&) = delete;
+        TradeNode& operator=(const TradeNode&) = delete;
+
+        SymbolId symbol_id;
+        BidSide buy_orders;
+        AskSide sell_orders;
+        // Set while an auction batch left orders resting without matching them
+        bool uncross_pending = false;
+        // Set while the book waits to be written to the shared memory publisher
+        bool publish_pending = false;
+
+        template <order::Side Side>
+        BookSide<Side>& book() {
+            if constexpr (Side == order::Side::buy) {
+                return buy_orders;
+            } else {
+                return sell_orders;
+            }
+        }
+    };
+
+} // engine namespace
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "order.hpp"
+
+namespace engine {
+
+    /*! \brief Open-addressing hash map keyed by order id.
+    *
+    * Linear probing over a power-of-two table, with backward-shift deletion so no tombstones
+    * are left behind and lookups stay short under a heavy insert/cancel mix.
+    * Used to go from an order id straight to the resting order, without walking the books.
+    */
+    template <typename Value>
+    class OrderIdMap {
+        public:
+            explicit OrderIdMap(std::size_t capacity = 1024) {
+                reserve(capacity);
+            }
+
+            /*!
+            *  \brief Returns a pointer to the value stored for this id, or nullptr if there is none.
+            */
+            Value* find(order::Id id) {
+                if (mSize == 0) return nullptr;
+                for (std::size_t i = slotFor(id);; i = (i + 1) & mMask) {
+                    Slot& slot = mSlots[i];
+                    if (!slot.used) return nullptr;
+                    if (slot.key == id) return &slot.value;
+                }
+            }
+
+            const Value* find(order::Id id) const {
+                return const_cast<OrderIdMap*>(this)->find(id);
+            }
+
+            bool contains(order::Id id) const {
+                return find(id) != nullptr;
+            }
+
+            /*!
+            *  \brief Adds a new id to the map.
+            *
+            *   \ret Returns false if the id was already present, in which case nothing is changed.
+            */
+            bool insert(order::Id id, const Value& value) {
+                // Keep the load factor under 1/2
+                if ((mSize + 1) * 2 > mSlots.size()) {
+                    rehash(mSlots.size() * 2);
+                }
+                for (std::size_t i = slotFor(id);; i = (i + 1) & mMask) {
+                    Slot& slot = mSlots[i];
+                    if (!slot.used) {
+                        slot.key = id;
+                        slot.value = value;
+                        slot.used = true;
+                        ++mSize;
+                        return true;
+                    }
+                    if (slot.key == id) return false;
+                }
+            }
+
+            /*!
+            *  \brief Removes an id from the map.
+            *
+            *   \ret Returns false if no such id was found.
+            */
+            bool erase(order::Id id) {
+                if (mSize == 0) return false;
+                std::size_t hole = slotFor(id);
+                for (;; hole = (hole + 1) & mMask) {
+                    if (!mSlots[hole].used) return false;
+                    if (mSlots[hole].key == id) break;
+                }
+                // Shift back the following entries of the cluster that would otherwise become unreachable
+                for (std::size_t next = (hole + 1) & mMask; mSlots[next].used; next = (next + 1) & mMask) {
+                    std::size_t home = slotFor(mSlots[next].key);
+                    if (((next - home) & mMask) >= ((next - hole) & mMask)) {
+                        mSlots[hole] = mSlots[next];
+                        hole = next;
+                    }
+                }
+                mSlots[hole].used = false;
+                --mSize;
+                return true;
+            }
+
+            void clear() {
+                for (auto& slot: mSlots) slot.used = false;
+                mSize = 0;
+            }
+
+            /*!
+            *  \brief Makes sure that at least `count` ids fit without the table having to grow.
+            */
+            void reserve(std::size_t count) {
+                std::size_t capacity = 16;
+                while (capacity < count * 2) capacity *= 2;
+                if (capacity > mSlots.size()) rehash(capacity);
+            }
+
+            std::size_t size() const { return mSize; }
+            bool empty() const { return mSize == 0; }
+
+        private:
+            struct Slot {
+                order::Id key {};
+                Value value {};
+                bool used = false;
+            };
+
+            std::vector<Slot> mSlots {};
+            std::size_t mMask = 0;
+            std::size_t mSize = 0;
+
+            std::size_t slotFor(order::Id id) const {
+                // splitmix64 finalizer, client ids are often sequential
+                id ^= id >> 30;
+                id *= 0xbf58476d1ce4e5b9ULL;
+                id ^= id >> 27;
+                id *= 0x94d049bb133111ebULL;
+                id ^= id >> 31;
+                return static_cast<std::size_t>(id) & mMask;
+            }
+
+            void rehash(std::size_t capacity) {
+                std::vector<Slot> old_slots(capacity);
+                old_slots.swap(mSlots);
+                mMask = capacity - 1;
+                mSize = 0;
+                for (const auto& slot: old_slots) {
+                    if (slot.used) insert(slot.key, slot.value);
+                }
+            }
+    };
+
+} // engine namespace
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "order.hpp"
+
+namespace engine {
+
+    /*! \brief Fixed-capacity storage for resting orders, recycled through a free list.
+    *
+    * All the slots are allocated up front, so taking and returning an order never calls the global allocator.
+    * If more orders are open at once than the pool was sized for, it grows by another chunk of
+    * the same size rather than failing, and keeps that capacity from then on.
+    * The pool owns the memory of every order it handed out, released all together on destruction.
+    *
+    * Each slot has a matching OrderDetails in a parallel array, reached through Order::pool_index,
+    * so the orders themselves stay one cache line each.
+    */
+    class OrderPool {
+        public:
+            explicit OrderPool(std::size_t capacity) : mChunkSize(capacity > 0 ? capacity : 1) {
+                grow();
+            }
+
+            OrderPool(const OrderPool&) = delete;
+            OrderPool& operator=(const OrderPool&) = delete;
+
+            /*!
+            *  \brief Copies the order into a free slot, and its details next to it.
+            */
+            Order* allocate(const Order& order, const OrderDetails& details) {
+                if (mFreeList == nullptr) grow();
+                Slot* slot = mFreeList;
+                mFreeList = slot->free.next;
+                const uint32_t index = slot->free.index;
+                ++mInUse;
+                Order* result = new (slot->storage) Order(order);
+                result->pool_index = index;
+                mDetails[index] = details;
+                return result;
+            }
+
+            /*!
+            *  \brief Gives the slot back, the order must come from this pool.
+            */
+            void deallocate(Order* order) {
+                const uint32_t index = order->pool_index;
+                // Order is trivially destructible, the slot can be reused as is
+                Slot* slot = reinterpret_cast<Slot*>(order);
+                slot->free = {mFreeList, index};
+                mFreeList = slot;
+                --mInUse;
+            }
+
+            OrderDetails& details(const Order* order) { return mDetails[order->pool_index]; }
+            const OrderDetails& details(const Order* order) const { return mDetails[order->pool_index]; }
+
+            std::size_t capacity() const { return mChunks.size() * mChunkSize; }
+            std::size_t size() const { return mInUse; }
+
+        private:
+            union Slot;
+
+            // A free slot remembers its index, for the order it will hold next
+            struct FreeSlot {
+                Slot* next;
+                uint32_t index;
+            };
+
+            union Slot {
+                FreeSlot free;
+                alignas(Order) unsigned char storage[sizeof(Order)];
+            };
+
+            std::size_t mChunkSize;
+            std::vector<std::unique_ptr<Slot[]>> mChunks {};
+            std::vector<OrderDetails> mDetails {};
+            Slot* mFreeList = nullptr;
+            std::size_t mInUse = 0;
+
+            void grow() {
+                const std::size_t first_index = mDetails.size();
+                mChunks.emplace_back(new Slot[mChunkSize]);
+                mDetails.resize(first_index + mChunkSize);
+                Slot* chunk = mChunks.back().get();
+                for (std::size_t i = mChunkSize; i > 0; --i) {
+                    chunk[i - 1].free = {mFreeList, static_cast<uint32_t>(first_index + i - 1)};
+                    mFreeList = &chunk[i - 1];
+                }
+            }
+    };
+
+} // engine namespace
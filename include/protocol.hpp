@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+#include "command.hpp"
+#include "order.hpp"
+#include "symbol_table.hpp"
+
+namespace protocol {
+
+    /*! \brief Fixed-layout binary order entry message, the same 32 bytes for INSERT, AMEND and PULL.
+    *
+    * Fields are in host byte order. Symbols are referred to by the ids returned from
+    * MatchingEngine::registerSymbol() and prices are in ticks (see order::Price).
+    * Fields that the message type does not use should be left zeroed.
+    */
+    struct Message {
+        engine::CommandType type;
+        order::Side side;
+        uint16_t reserved;
+        engine::SymbolId symbol;
+        order::Id id;
+        order::Price price;
+        int32_t volume;
+        uint32_t padding;
+    };
+
+    static_assert(sizeof(Message) == 32, "Message layout is part of the wire format");
+    static_assert(std::is_trivially_copyable<Message>::value, "Messages are copied straight off the wire");
+
+    inline Message makeInsert(order::Id id, engine::SymbolId symbol, order::Side side, order::Price price, int32_t volume) {
+        return {engine::CommandType::insert, side, 0, symbol, id, price, volume, 0};
+    }
+
+    inline Message makeAmend(order::Id id, order::Price price, int32_t volume) {
+        return {engine::CommandType::amend, order::Side::buy, 0, 0, id, price, volume, 0};
+    }
+
+    inline Message makePull(order::Id id) {
+        return {engine::CommandType::pull, order::Side::buy, 0, 0, id, 0, 0, 0};
+    }
+
+    /*!
+    *  \brief A message the engine rejects as malformed, e.g. to journal a text line that did not parse.
+    */
+    inline Message makeInvalid(order::Id id) {
+        return {engine::CommandType::invalid, order::Side::buy, 0, 0, id, 0, 0, 0};
+    }
+
+} // protocol namespace
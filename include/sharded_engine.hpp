@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "command.hpp"
+#include "matching_engine.hpp"
+#include "order_index.hpp"
+#include "spsc_queue.hpp"
+#include "trade_sink.hpp"
+
+namespace engine {
+
+    /*! \brief A trade tagged with the position, in the input, of the command that caused it.
+    */
+    struct SequencedTrade {
+        uint64_t sequence;
+        TradeEvent trade;
+    };
+
+    struct SequencedReject {
+        uint64_t sequence;
+        RejectEvent reject;
+    };
+
+    /*! \brief Collects a shard's trades and rejects, tagged with the command being processed.
+    */
+    class SequencedSink : public TradeSink {
+        public:
+            void onTrade(const TradeEvent& trade) override { trades.push_back({sequence, trade}); }
+            void onReject(const RejectEvent& reject) override { rejects.push_back({sequence, reject}); }
+
+            uint64_t sequence = 0;
+            std::vector<SequencedTrade> trades {};
+            std::vector<SequencedReject> rejects {};
+    };
+
+} // engine namespace
+
+
+/*! \brief Multi-threaded front end that spreads symbols over several MatchingEngines.
+ *
+ *  Symbols are hashed onto N shards, each one a MatchingEngine running on its own worker thread
+ *  and fed through its own single-producer/single-consumer ring. The calling thread parses the
+ *  input and routes every command, so commands for one symbol always reach their shard in input order.
+ *  PULL and AMEND only carry an order id; they follow the shard the id was last inserted on.
+ *
+ *  A thread with nothing to do, a worker between batches or the caller waiting on a shard, spins
+ *  for a short while and then sleeps until the other side hands it work, so an idle engine uses no CPU.
+ *
+ *  Trades and rejects are tagged with the input position of the command that caused them and merged
+ *  back in that order, so the output is deterministic and the same as a single MatchingEngine's.
+ */
+class ShardedMatchingEngine {
+    public:
+        explicit ShardedMatchingEngine(std::size_t shard_count, const engine::EngineConfig& config = {});
+        ~ShardedMatchingEngine();
+
+        ShardedMatchingEngine(const ShardedMatchingEngine&) = delete;
+        ShardedMatchingEngine& operator=(const ShardedMatchingEngine&) = delete;
+
+        /*!
+        *  \brief Same contract as MatchingEngine::processOrders().
+        *
+        *   Blocks until every shard has worked through the batch.
+        */
+        std::vector<std::string> processOrders(const std::vector<std::string>& input);
+
+        std::size_t shardCount() const { return mShards.size(); }
+
+        /*!
+        *  \brief Number of order ids the router keeps a shard for, at most the orders still resting.
+        */
+        std::size_t routedOrders() const { return mOrderShards.size(); }
+
+    private:
+        struct Shard;
+
+        std::vector<std::unique_ptr<Shard>> mShards {};
+        // Shard that each order id was last inserted on, while the order may still be resting there
+        engine::OrderIdMap<uint32_t> mOrderShards;
+        // Ids of the batch that may have left their book: pulled, traded or refused on insert
+        std::vector<order::Id> mRetiredIds {};
+
+        uint32_t shardFor(std::string_view symbol) const;
+
+        /*!
+        *  \brief Hands a command to a shard, waiting while its ring is full.
+        *
+        *   `parsed` is the parser's verdict on the line, the shard rejects it with that code if it is not none.
+        */
+        void dispatch(Shard& shard, uint64_t sequence, const engine::Command& command, engine::RejectCode parsed);
+
+        /*!
+        *  \brief Waits until the shard has processed everything dispatched to it.
+        */
+        void drain(Shard& shard);
+
+        /*!
+        *  \brief Drops the ids of mRetiredIds that no longer rest on their shard, so the map only
+        *   holds resting orders. Called once every shard is drained.
+        */
+        void forgetRetiredIds();
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "order.hpp"
+#include "order_book.hpp"
+#include "symbol_table.hpp"
+
+namespace engine {
+
+    constexpr uint64_t shared_book_magic = 0x31304b4f4f42454dULL; // "MEBOOK01"
+
+    /*! \brief Start of the shared memory region, followed by `max_symbols` records of `record_size` bytes.
+    *
+    * The record of a symbol sits at its SymbolId, symbols past `max_symbols` are not published.
+    */
+    struct alignas(64) SharedBookHeader {
+        uint64_t magic;
+        uint32_t max_symbols;
+        // Levels published per side
+        uint32_t depth;
+        uint64_t record_size;
+        // Every record below it may be in use
+        std::atomic<uint32_t> symbol_count;
+    };
+
+    /*! \brief One published level.
+    */
+    struct SharedLevel {
+        std::atomic<int64_t> price;
+        std::atomic<int64_t> volume;
+        std::atomic<uint32_t> order_count;
+    };
+
+    /*! \brief The published book of one symbol, followed by `depth` bid levels then `depth` ask levels.
+    *
+    * The record is guarded by a seqlock: the publisher makes `version` odd, writes, then makes it even
+    * again. A reader copies the record and keeps the copy if `version` was the same even value before
+    * and after. Every field is a lock-free atomic, so the region works across processes and reading
+    * a record that is being written is not a data race.
+    */
+    struct alignas(64) SharedBookRecord {
+        std::atomic<uint64_t> version;
+        // Sequence of the last message the book reflects
+        std::atomic<uint64_t> sequence;
+        std::atomic<uint32_t> bid_count;
+        std::atomic<uint32_t> ask_count;
+        // Set once `symbol` is written, it never changes after
+        std::atomic<uint32_t> ready;
+        // Zero terminated, longer names are cut
+        char symbol[36];
+    };
+
+    static_assert(sizeof(SharedBookHeader) == 64, "Header layout is part of the shared book format");
+    static_assert(sizeof(SharedBookRecord) == 64, "Record layout is part of the shared book format");
+    static_assert(sizeof(SharedLevel) == 24, "Level layout is part of the shared book format");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<int64_t>::is_always_lock_free
+                  && std::atomic<uint32_t>::is_always_lock_free, "Shared atomics must not rely on a lock");
+
+    /*! \brief Copy of a published book, as SharedBookReader::read() returns it.
+    */
+    struct SharedBookView {
+        std::string symbol {};
+        order::Sequence sequence = 0;
+        std::vector<DepthLevel> bids {};
+        std::vector<DepthLevel> asks {};
+    };
+
+    /*! \brief Writes the top levels of the engine's books to a POSIX shared memory region.
+    *
+    *   The region is created and mapped up front, publishing a book only stores to it:
+    *   no syscall, no lock and no allocation on the matching thread. Readers never hold
+    *   the publisher back, a reader that raced with an update retries on its side.
+    */
+    class SharedBookPublisher {
+        public:
+            /*!
+            *  \brief Creates the region `name`, e.g. "/matching_engine", replacing any previous one.
+            *
+            * \throws std::runtime_error if the region can not be created or mapped.
+            */
+            SharedBookPublisher(const std::string& name, std::size_t max_symbols, std::size_t depth);
+
+            SharedBookPublisher(const SharedBookPublisher&) = delete;
+            SharedBookPublisher& operator=(const SharedBookPublisher&) = delete;
+
+            /*!
+            *  \brief Unmaps and removes the region, readers that have it mapped keep their mapping.
+            */
+            ~SharedBookPublisher();
+
+            /*!
+            *  \brief Writes the top `depth` levels of both sides of a book, nothing if its id is past `max_symbols`.
+            */
+            void publish(const TradeNode& node, std::string_view symbol, order::Sequence sequence);
+
+            std::size_t maxSymbols() const { return mHeader->max_symbols; }
+            std::size_t depth() const { return mHeader->depth; }
+
+        private:
+            std::string mName;
+            std::size_t mSize;
+            SharedBookHeader* mHeader;
+
+            SharedBookRecord& record(SymbolId symbol);
+    };
+
+    /*! \brief Maps a region written by a SharedBookPublisher, from any process.
+    */
+    class SharedBookReader {
+        public:
+            /*!
+            * \throws std::runtime_error if the region does not exist or is not a shared book.
+            */
+            explicit SharedBookReader(const std::string& name);
+
+            SharedBookReader(const SharedBookReader&) = delete;
+            SharedBookReader& operator=(const SharedBookReader&) = delete;
+            ~SharedBookReader();
+
+            /*!
+            *  \brief Ids below this one may have a published book.
+            */
+            std::size_t symbolCount() const;
+            std::size_t depth() const { return mHeader->depth; }
+
+            /*!
+            *  \brief Takes a consistent copy of the book of `symbol`. Never blocks the publisher.
+            *
+            *   The vectors in `out` are reused, so polling does not allocate once they are large enough.
+            *
+            *   \ret Returns false if the symbol was never published, or if it kept changing for as long as
+            *        the reader was willing to retry; a later call will get it.
+            */
+            bool read(SymbolId symbol, SharedBookView& out) const;
+
+        private:
+            std::size_t mSize;
+            const SharedBookHeader* mHeader;
+
+            const SharedBookRecord& record(SymbolId symbol) const;
+    };
+
+} // engine namespace
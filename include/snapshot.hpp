@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+#include "order.hpp"
+#include "symbol_table.hpp"
+
+namespace engine {
+
+    constexpr uint64_t snapshot_magic = 0x323050414e53454dULL; // "MESNAP02"
+
+    /*! \brief Start of a snapshot file.
+    *
+    * The file is flat and holds no pointers: the header is followed by `order_count` SnapshotOrders,
+    * then `symbol_count` SnapshotSymbols, then the symbol names back to back.
+    * Fields are in host byte order.
+    */
+    struct SnapshotHeader {
+        uint64_t magic;
+        // Last message applied before the snapshot was taken
+        order::Sequence sequence;
+        // Size the journal had at that point, a replay starts there
+        uint64_t journal_offset;
+        uint64_t order_count;
+        uint64_t symbol_count;
+        uint64_t names_size;
+    };
+
+    /*! \brief A resting order. Orders are stored book by book, bids then asks, each side from
+    *          its best level to its worst one and each level in time priority.
+    */
+    struct SnapshotOrder {
+        order::Id id;
+        order::Price price;
+        order::Sequence last_updated;
+        order::Sequence entered;
+        order::Sequence amended;
+        SymbolId symbol;
+        int32_t volume;
+        int32_t original_volume;
+        order::Side side;
+        uint8_t padding[3];
+    };
+
+    /*! \brief A symbol table entry, in id order.
+    */
+    struct SnapshotSymbol {
+        // Where the name starts in the names block
+        uint32_t name_offset;
+        uint32_t name_size;
+        // Whether the symbol has a book, i.e. is listed in the output
+        uint32_t listed;
+    };
+
+    static_assert(sizeof(SnapshotHeader) == 48, "Header layout is part of the snapshot format");
+    static_assert(sizeof(SnapshotOrder) == 56, "Order layout is part of the snapshot format");
+    static_assert(sizeof(SnapshotSymbol) == 12, "Symbol layout is part of the snapshot format");
+    static_assert(std::is_trivially_copyable<SnapshotOrder>::value, "Snapshots are read straight from the mapping");
+
+    /*! \brief Outcome of MatchingEngine::loadSnapshot().
+    */
+    struct SnapshotInfo {
+        order::Sequence sequence = 0;
+        uint64_t journal_offset = 0;
+        std::size_t orders = 0;
+    };
+
+} // engine namespace
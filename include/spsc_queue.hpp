@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace engine {
+
+    /*! \brief Bounded lock-free ring buffer for exactly one producer thread and one consumer thread.
+    *
+    * Capacity is rounded up to a power of two. Each side keeps a cached copy of the other side's
+    * position, so the shared cache lines are only touched when the ring looks full or empty.
+    */
+    template <typename T>
+    class SpscQueue {
+        public:
+            explicit SpscQueue(std::size_t capacity) {
+                std::size_t size = 2;
+                while (size < capacity) size *= 2;
+                mBuffer.resize(size);
+                mMask = size - 1;
+            }
+
+            SpscQueue(const SpscQueue&) = delete;
+            SpscQueue& operator=(const SpscQueue&) = delete;
+
+            /*!
+            *  \brief Producer side.
+            *
+            *   \ret Returns false if the ring is full, nothing is written then.
+            */
+            bool tryPush(const T& value) {
+                const std::size_t tail = mTail.load(std::memory_order_relaxed);
+                if (tail - mCachedHead > mMask) {
+                    mCachedHead = mHead.load(std::memory_order_acquire);
+                    if (tail - mCachedHead > mMask) return false;
+                }
+                mBuffer[tail & mMask] = value;
+                mTail.store(tail + 1, std::memory_order_release);
+                return true;
+            }
+
+            /*!
+            *  \brief Consumer side.
+            *
+            *   \ret Returns false if the ring is empty, `value` is left untouched then.
+            */
+            bool tryPop(T& value) {
+                const std::size_t head = mHead.load(std::memory_order_relaxed);
+                if (head == mCachedTail) {
+                    mCachedTail = mTail.load(std::memory_order_acquire);
+                    if (head == mCachedTail) return false;
+                }
+                value = mBuffer[head & mMask];
+                mHead.store(head + 1, std::memory_order_release);
+                return true;
+            }
+
+            /*!
+            *  \brief Consumer side. True if tryPop() would find nothing right now.
+            */
+            bool empty() const {
+                return mHead.load(std::memory_order_relaxed) == mTail.load(std::memory_order_acquire);
+            }
+
+            std::size_t capacity() const { return mMask + 1; }
+
+        private:
+            std::vector<T> mBuffer {};
+            std::size_t mMask = 0;
+
+            // Consumer position, and the consumer's last look at the producer position
+            alignas(64) std::atomic<std::size_t> mHead {0};
+            std::size_t mCachedTail = 0;
+
+            // Producer position, and the producer's last look at the consumer position
+            alignas(64) std::atomic<std::size_t> mTail {0};
+            std::size_t mCachedHead = 0;
+    };
+
+} // engine namespace
@@ -1,51 +1,159 @@
 #pragma once
 
-#include <sstream>
-#include <iomanip>
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <limits>
+
+#include "order.hpp"
+#include "command.hpp"
 
 namespace utils {
 
-    inline bool isValidDouble(const std::string& str) {
-        try {
-            std::stod(str);     
-        } catch (const std::invalid_argument&) {
-            return false;
+    /*!
+    *  \brief Parses a decimal price with at most 4 decimals straight into ticks, without going through double.
+    *
+    *   \ret Returns false if the text is not a valid price.
+    */
+    inline bool parsePrice(std::string_view text, order::Price& price) {
+        std::size_t pos = 0;
+        const bool negative = !text.empty() && text[0] == '-';
+        if (negative) ++pos;
+        order::Price value = 0;
+        std::size_t digits = 0;
+        for (; pos < text.size() && text[pos] >= '0' && text[pos] <= '9'; ++pos, ++digits) {
+            if (value > (std::numeric_limits<order::Price>::max() / order::price_scale - 9) / 10) return false;
+            value = value * 10 + (text[pos] - '0');
+        }
+        value *= order::price_scale;
+        if (pos < text.size() && text[pos] == '.') {
+            ++pos;
+            order::Price decimal_weight = order::price_scale;
+            for (; pos < text.size() && text[pos] >= '0' && text[pos] <= '9'; ++pos, ++digits) {
+                decimal_weight /= 10;
+                if (decimal_weight == 0) return false;
+                value += (text[pos] - '0') * decimal_weight;
+            }
         }
+        if (digits == 0 || pos != text.size()) return false;
+        price = negative ? -value : value;
         return true;
     }
 
-    inline bool isValidPrice(const std::string& price) {
-        if (!isValidDouble(price)) return false;
-        auto found_location = price.find('.');
-        if (found_location != std::string::npos) {
-            std::string substring(price.begin() + found_location + 1, price.end());
-            if (substring.size() > 4) return false;
+    /*!
+    *  \brief Appends the price in its shortest decimal form, without trailing zeroes, e.g. 1725000 -> "172.5".
+    */
+    inline void appendPrice(std::string& out, order::Price price) {
+        char buffer[32];
+        char* end = buffer + sizeof(buffer);
+        char* begin = end;
+        uint64_t magnitude = price < 0 ? 0 - static_cast<uint64_t>(price) : static_cast<uint64_t>(price);
+        uint64_t decimals = magnitude % order::price_scale;
+        uint64_t integer = magnitude / order::price_scale;
+        if (decimals != 0) {
+            int width = 4;
+            while (decimals % 10 == 0) {
+                decimals /= 10;
+                --width;
+            }
+            for (; width > 0; --width, decimals /= 10) {
+                *--begin = static_cast<char>('0' + decimals % 10);
+            }
+            *--begin = '.';
         }
-        return true;
+        do {
+            *--begin = static_cast<char>('0' + integer % 10);
+            integer /= 10;
+        } while (integer != 0);
+        if (price < 0) *--begin = '-';
+        out.append(begin, end);
     }
 
-    inline std::vector<std::string> splitCommands(const std::string& order) {
-        std::stringstream order_stream(order);
-        std::string segment;
-        std::vector<std::string> commands_list;
-        while(std::getline(order_stream, segment, ',')) {
-        commands_list.push_back(segment);
-        }
-        return commands_list;
+    /*!
+    *  \brief Parses a whole decimal field, rejecting empty fields, signs where not allowed and trailing characters.
+    */
+    template <typename Integer>
+    inline bool parseInteger(std::string_view text, Integer& value) {
+        if (text.empty()) return false;
+        const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+        return error == std::errc() && end == text.data() + text.size();
     }
-    
-    inline std::string dropTrailingZeroes(const std::string& value) {
-        std::stringstream ss;
-        ss << std::fixed << std::setprecision(2) << value;
-        std::string str = ss.str();
-        if (str.find('.') != std::string::npos) {
-            str = str.substr(0, str.find_last_not_of('0') + 1);
-            // If the decimal point is now the last character, remove that as well
-            if(str.find('.') == str.size() - 1) {
-                str = str.substr(0, str.size() - 1);
+
+    /*!
+    *  \brief Appends the decimal form of an integer, without a temporary string.
+    */
+    template <typename Integer>
+    inline void appendInteger(std::string& out, Integer value) {
+        char buffer[24];
+        const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out.append(buffer, result.ptr);
+    }
+
+    /*!
+    *  \brief Tokenizes one input line in a single pass, without allocating or throwing.
+    *
+    *   Expected formats are "INSERT,id,symbol,BUY|SELL,price,volume", "AMEND,id,price,volume" and "PULL,id".
+    *   Fields are only checked for syntax here, the engine checks their values.
+    *
+    *   \ret Returns RejectCode::none if the line is a valid command, otherwise why it is not, in the
+    *         order the engine checks the fields. command.type is still set when the command name itself
+    *         was recognised, and command.id when it parsed (0 otherwise), so the reject can name the command.
+    */
+    inline engine::RejectCode parseCommand(std::string_view line, engine::Command& command) {
+        constexpr std::size_t max_fields = 6;
+        std::string_view fields[max_fields];
+        std::size_t field_count = 0;
+        std::size_t start = 0;
+        // One more field than any command has is enough to tell the line is malformed
+        bool extra_fields = false;
+        while (true) {
+            const std::size_t comma = line.find(',', start);
+            if (field_count == max_fields) {
+                extra_fields = true;
+                break;
             }
+            fields[field_count++] = line.substr(start, comma == std::string_view::npos ? std::string_view::npos : comma - start);
+            if (comma == std::string_view::npos) break;
+            start = comma + 1;
+        }
+
+        if (fields[0] == "INSERT") {
+            command.type = engine::CommandType::insert;
+        } else if (fields[0] == "AMEND") {
+            command.type = engine::CommandType::amend;
+        } else if (fields[0] == "PULL") {
+            command.type = engine::CommandType::pull;
+        } else {
+            command.type = engine::CommandType::invalid;
+        }
+        command.id = 0;
+        if (command.type == engine::CommandType::invalid) return engine::RejectCode::malformed;
+        if (field_count < 2 || !parseInteger(fields[1], command.id)) {
+            // A field that only partly parsed may have left a value behind
+            command.id = 0;
+            return engine::RejectCode::malformed;
+        }
+
+        switch (command.type) {
+            case engine::CommandType::insert:
+                if (extra_fields || field_count != 6 || fields[2].empty()) return engine::RejectCode::malformed;
+                command.symbol = fields[2];
+                if (fields[3] == "BUY") {
+                    command.side = order::Side::buy;
+                } else if (fields[3] == "SELL") {
+                    command.side = order::Side::sell;
+                } else return engine::RejectCode::invalid_side;
+                if (!parseInteger(fields[5], command.volume)) return engine::RejectCode::invalid_volume;
+                if (!parsePrice(fields[4], command.price)) return engine::RejectCode::invalid_price;
+                return engine::RejectCode::none;
+            case engine::CommandType::amend:
+                if (extra_fields || field_count != 4) return engine::RejectCode::malformed;
+                if (!parseInteger(fields[3], command.volume)) return engine::RejectCode::invalid_volume;
+                if (!parsePrice(fields[2], command.price)) return engine::RejectCode::invalid_price;
+                return engine::RejectCode::none;
+            default:
+                return extra_fields || field_count != 2 ? engine::RejectCode::malformed : engine::RejectCode::none;
         }
-        return str;
     }
 
 } // utils namespace
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace engine {
+
+    using SymbolId = uint32_t;
+
+    /*! \brief Interns ticker names into dense integer ids, handed out in order of first appearance.
+    *
+    * Names are stored in a deque so references to them stay valid while new symbols are added,
+    * which lets the hash index key on views of them: looking a symbol up never builds a string.
+    */
+    class SymbolTable {
+        public:
+            /*!
+            *  \brief Returns the id of the symbol, registering it if it was never seen before.
+            */
+            SymbolId intern(std::string_view symbol) {
+                auto id_it = mIds.find(symbol);
+                if (id_it != mIds.end()) return id_it->second;
+                const auto id = static_cast<SymbolId>(mNames.size());
+                mNames.emplace_back(symbol);
+                mIds.emplace(mNames.back(), id);
+                return id;
+            }
+
+            /*!
+            *  \brief Looks up a symbol without registering it.
+            *
+            *   \ret Returns false if the symbol was never interned.
+            */
+            bool find(std::string_view symbol, SymbolId& id) const {
+                auto id_it = mIds.find(symbol);
+                if (id_it == mIds.end()) return false;
+                id = id_it->second;
+                return true;
+            }
+
+            bool contains(SymbolId id) const { return id < mNames.size(); }
+
+            const std::string& name(SymbolId id) const { return mNames[id]; }
+
+            std::size_t size() const { return mNames.size(); }
+
+        private:
+            std::deque<std::string> mNames {};
+            std::unordered_map<std::string_view, SymbolId> mIds {};
+    };
+
+} // engine namespace
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "command.hpp"
+#include "order.hpp"
+#include "symbol_table.hpp"
+
+namespace engine {
+
+    /*! \brief One execution, reported as soon as the match happens.
+    *
+    * The symbol view points into the engine's symbol table and stays valid for the engine's lifetime.
+    */
+    struct TradeEvent {
+        SymbolId symbol_id;
+        std::string_view symbol;
+        order::Price price;
+        int volume;
+        order::Id aggressive_id;
+        order::Id passive_id;
+    };
+
+    /*! \brief A command the engine refused. Nothing else happens for it, the engine carries on.
+    *
+    * A line the parser refused carries what could be read of it: its type if the command name is known,
+    * the invalid type otherwise, and its id if that field parsed, 0 otherwise.
+    */
+    struct RejectEvent {
+        CommandType type;
+        RejectCode code;
+        order::Id id;
+    };
+
+    /*! \brief New totals of one price level, once a batch of commands is done with it.
+    *
+    * A volume of zero means the level is gone. Applying the updates in order keeps a mirror of the book.
+    */
+    struct LevelUpdate {
+        SymbolId symbol_id;
+        order::Side side;
+        order::Price price;
+        int64_t volume;
+        uint32_t order_count;
+        // Sequence of the last message of the batch
+        order::Sequence sequence;
+    };
+
+    /*! \brief Receives the executions of a MatchingEngine, one call per trade, on the matching thread.
+    *
+    *   Rejects go through the same sink, in order with the trades, and level updates follow the
+    *   trades of their batch when the engine is configured to send them. Sinks that only want
+    *   trades can leave onReject() and onLevelUpdate() out.
+    */
+    class TradeSink {
+        public:
+            virtual ~TradeSink() = default;
+            virtual void onTrade(const TradeEvent& trade) = 0;
+            virtual void onReject(const RejectEvent&) {}
+            virtual void onLevelUpdate(const LevelUpdate&) {}
+    };
+
+    /*! \brief Drops every trade. For benchmarks, or when only the book matters.
+    */
+    class NullSink : public TradeSink {
+        public:
+            void onTrade(const TradeEvent&) override {}
+    };
+
+    /*! \brief Keeps the raw trade events in memory.
+    */
+    class VectorSink : public TradeSink {
+        public:
+            void onTrade(const TradeEvent& trade) override { trades.push_back(trade); }
+            void onReject(const RejectEvent& reject) override { rejects.push_back(reject); }
+            void onLevelUpdate(const LevelUpdate& update) override { level_updates.push_back(update); }
+
+            std::vector<TradeEvent> trades {};
+            std::vector<RejectEvent> rejects {};
+            std::vector<LevelUpdate> level_updates {};
+    };
+
+    /*! \brief Formats every trade into a "SYMBOL,price,volume,aggressive_id,passive_id" line,
+    *          and every reject into a "REJECT,id,reason" line.
+    *
+    *   This is the output processOrders() returns when the engine is built without a sink.
+    */
+    class StringSink : public TradeSink {
+        public:
+            void onTrade(const TradeEvent& trade) override;
+            void onReject(const RejectEvent& reject) override;
+
+            /*!
+            *  \brief Hands over the lines collected so far and starts a new list.
+            */
+            std::vector<std::string> take();
+
+        private:
+            std::vector<std::string> mLines {};
+    };
+
+    /*! \brief Writes the same lines as StringSink to a file, through a large buffer.
+    *
+    *   Lines reach the file when the buffer fills up, on flush() and on destruction.
+    *   A write that fails while the engine is matching is only recorded, the callbacks never
+    *   throw: the sink drops every line from then on and the next flush() reports the error.
+    */
+    class BufferedFileSink : public TradeSink {
+        public:
+            /*!
+            *  \brief Creates, or truncates, the file at `path`.
+            *
+            * \throws std::runtime_error if the file can not be opened.
+            */
+            explicit BufferedFileSink(const std::string& path, std::size_t buffer_size = 1 << 20);
+
+            /*!
+            *  \brief Writes to an already open file, e.g. stdout. The file is not closed by the sink.
+            */
+            explicit BufferedFileSink(std::FILE* file, std::size_t buffer_size = 1 << 20);
+
+            BufferedFileSink(const BufferedFileSink&) = delete;
+            BufferedFileSink& operator=(const BufferedFileSink&) = delete;
+            ~BufferedFileSink() override;
+
+            void onTrade(const TradeEvent& trade) override;
+            void onReject(const RejectEvent& reject) override;
+
+            /*!
+            *  \brief Writes out everything buffered so far.
+            *
+            * \throws std::runtime_error if this write, or any earlier one, failed.
+            */
+            void flush();
+
+            /*!
+            *  \brief True once a write failed, lines are dropped from then on.
+            */
+            bool failed() const { return mFailed; }
+
+        private:
+            std::FILE* mFile;
+            bool mOwnsFile;
+            std::size_t mBufferSize;
+            std::string mBuffer {};
+            bool mFailed = false;
+
+            /*!
+            *  \brief Hands the buffer to the file, recording a failure instead of throwing.
+            */
+            void writeBuffer();
+    };
+
+    /*!
+    *  \brief Appends the trade in the output format, without a line terminator.
+    */
+    void appendTrade(std::string& out, const TradeEvent& trade);
+    void appendReject(std::string& out, const RejectEvent& reject);
+
+} // engine namespace
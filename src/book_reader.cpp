@@ -0,0 +1,98 @@
+#include "shared_book.hpp"
+#include "string_utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+
+/*
+*  Usage: MatchingEngineBookReader NAME [--interval MILLISECONDS]
+*
+*  Prints the books a MatchingEngine publishes to the shared memory region NAME, see
+*  MatchingEngine::setBookPublisher(). Each book gets a "===SYMBOL=== sequence" line followed by
+*  "bid_price,bid_volume,bid_orders,ask_price,ask_volume,ask_orders" rows, best prices first.
+*  The books are printed once, or every MILLISECONDS until the process is stopped.
+*  Reading never holds the engine back.
+*/
+
+namespace {
+    struct Options {
+        std::string name {};
+        long interval_ms = 0;
+    };
+
+    Options parseOptions(int argc, char** argv) {
+        Options options;
+        for (int i = 1; i < argc; ++i) {
+            const std::string_view argument = argv[i];
+            if (argument == "--interval" && i + 1 < argc) {
+                options.interval_ms = std::stol(argv[++i]);
+            } else if (options.name.empty() && argument.substr(0, 2) != "--") {
+                options.name = argv[i];
+            } else {
+                throw std::invalid_argument(argv[i]);
+            }
+        }
+        if (options.name.empty()) throw std::invalid_argument("missing NAME");
+        return options;
+    }
+
+    void appendLevel(std::string& out, const std::vector<engine::DepthLevel>& levels, std::size_t i) {
+        if (i < levels.size()) {
+            utils::appendPrice(out, levels[i].price);
+            out.push_back(',');
+            utils::appendInteger(out, levels[i].volume);
+            out.push_back(',');
+            utils::appendInteger(out, levels[i].order_count);
+        } else {
+            out.append(",,");
+        }
+    }
+
+    void printBooks(const engine::SharedBookReader& reader) {
+        engine::SharedBookView book;
+        std::string out;
+        for (engine::SymbolId symbol = 0; symbol < reader.symbolCount(); ++symbol) {
+            if (!reader.read(symbol, book)) continue;
+            out.append("===").append(book.symbol).append("=== ");
+            utils::appendInteger(out, book.sequence);
+            out.push_back('\n');
+            for (std::size_t i = 0; i < std::max(book.bids.size(), book.asks.size()); ++i) {
+                appendLevel(out, book.bids, i);
+                out.push_back(',');
+                appendLevel(out, book.asks, i);
+                out.push_back('\n');
+            }
+        }
+        std::fwrite(out.data(), 1, out.size(), stdout);
+        std::fflush(stdout);
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    try {
+        options = parseOptions(argc, argv);
+    } catch (const std::invalid_argument& error) {
+        std::fprintf(stderr, "Invalid argument: %s\n"
+                             "Usage: %s NAME [--interval MILLISECONDS]\n", error.what(), argv[0]);
+        return 2;
+    }
+
+    try {
+        const engine::SharedBookReader reader(options.name);
+        printBooks(reader);
+        while (options.interval_ms > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(options.interval_ms));
+            printBooks(reader);
+        }
+    } catch (const std::runtime_error& error) {
+        std::fprintf(stderr, "%s\n", error.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,148 @@
+#include "continuous_engine.hpp"
+
+#include <chrono>
+
+namespace {
+    // Polls the sequencer makes before it sleeps, enough to ride out the gaps between bursts
+    constexpr unsigned spin_limit = 1000;
+}
+
+ContinuousMatchingEngine::ContinuousMatchingEngine(const std::vector<std::string>& symbols, const engine::ContinuousConfig& config)
+    : mConfig(config)
+    , mEngine(mSink, config.engine)
+    , mIngress(config.ingress_capacity)
+    , mReports(config.report_capacity)
+{
+    for (const auto& symbol: symbols) {
+        mEngine.registerSymbol(symbol);
+    }
+    mEngine.setJournal(config.journal);
+    mSequencer = std::thread([this] { run(); });
+}
+
+ContinuousMatchingEngine::~ContinuousMatchingEngine() {
+    stop();
+}
+
+bool ContinuousMatchingEngine::findSymbol(std::string_view symbol, engine::SymbolId& id) const {
+    return mEngine.findSymbol(symbol, id);
+}
+
+bool ContinuousMatchingEngine::submit(const protocol::Message& message) {
+    if (!mIngress.tryPush(message)) {
+        switch (mConfig.backpressure) {
+            case engine::Backpressure::reject:
+                return false;
+            case engine::Backpressure::spin:
+                while (!mIngress.tryPush(message)) {}
+                break;
+            default: {
+                std::unique_lock<std::mutex> lock(mBlockedMutex);
+                mBlockedGateways.fetch_add(1);
+                // The timeout covers a wakeup sent between a failed push and the wait
+                while (!mIngress.tryPush(message)) {
+                    mNotFull.wait_for(lock, std::chrono::microseconds(100));
+                }
+                mBlockedGateways.fetch_sub(1);
+            }
+        }
+    }
+    wakeSequencer();
+    return true;
+}
+
+bool ContinuousMatchingEngine::pollReport(engine::ExecutionReport& report) {
+    if (!mReports.tryPop(report)) return false;
+    // The sequencer may be waiting for room in the outbound ring
+    wakeSequencer();
+    return true;
+}
+
+void ContinuousMatchingEngine::stop() {
+    if (!mSequencer.joinable()) return;
+    mRunning.store(false, std::memory_order_release);
+    {
+        // Taken unconditionally, the sequencer checks `mRunning` under the mutex before it sleeps
+        std::lock_guard<std::mutex> lock(mSequencerMutex);
+        mSequencerWakeup.notify_one();
+    }
+    mSequencer.join();
+}
+
+std::vector<std::string> ContinuousMatchingEngine::snapshot() const {
+    return mEngine.snapshot();
+}
+
+void ContinuousMatchingEngine::run() {
+    protocol::Message message;
+    while (true) {
+        if (mIngress.tryPop(message)) {
+            sequence(message);
+            if (mBlockedGateways.load() > 0) {
+                std::lock_guard<std::mutex> lock(mBlockedMutex);
+                mNotFull.notify_all();
+            }
+            continue;
+        }
+        if (!mRunning.load(std::memory_order_acquire)) {
+            // Everything submitted before stop() is in the ring by now
+            while (mIngress.tryPop(message)) sequence(message);
+            return;
+        }
+        mEngine.poll();
+        await([this] { return !mIngress.empty() || !mRunning.load(std::memory_order_acquire); }, true);
+    }
+}
+
+void ContinuousMatchingEngine::sequence(const protocol::Message& message) {
+    ++mSequence;
+    mEngine.processMessage(message, mSequence);
+}
+
+void ContinuousMatchingEngine::publish(const engine::ExecutionReport& report) {
+    if (mReports.tryPush(report)) return;
+    await([this, &report] { return mReports.tryPush(report); }, false);
+}
+
+template <typename Ready>
+void ContinuousMatchingEngine::await(Ready ready, bool until_poll) {
+    for (unsigned spins = 0; spins < spin_limit; ++spins) {
+        if (ready()) return;
+        std::this_thread::yield();
+    }
+    std::unique_lock<std::mutex> lock(mSequencerMutex);
+    mSequencerParked.store(true, std::memory_order_relaxed);
+    // Pairs with the fence in wakeSequencer(): either the other side sees the flag, or `ready` sees its progress
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::chrono::steady_clock::time_point deadline;
+    if (until_poll && mEngine.pollDeadline(deadline)) {
+        mSequencerWakeup.wait_until(lock, deadline, ready);
+    } else {
+        mSequencerWakeup.wait(lock, ready);
+    }
+    mSequencerParked.store(false, std::memory_order_relaxed);
+}
+
+void ContinuousMatchingEngine::wakeSequencer() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!mSequencerParked.load(std::memory_order_relaxed)) return;
+    std::lock_guard<std::mutex> lock(mSequencerMutex);
+    mSequencerWakeup.notify_one();
+}
+
+void ContinuousMatchingEngine::ReportSink::onTrade(const engine::TradeEvent& trade) {
+    engine::ExecutionReport report;
+    report.type = engine::ReportType::trade;
+    report.sequence = mOwner.mSequence;
+    report.trade = trade;
+    mOwner.publish(report);
+}
+
+void ContinuousMatchingEngine::ReportSink::onReject(const engine::RejectEvent& reject) {
+    engine::ExecutionReport report;
+    report.type = engine::ReportType::reject;
+    report.sequence = mOwner.mSequence;
+    report.id = reject.id;
+    report.reject = reject.code;
+    mOwner.publish(report);
+}
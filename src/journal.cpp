@@ -0,0 +1,154 @@
+#include "journal.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace engine {
+
+JournalWriter::JournalWriter(const std::string& path, const JournalConfig& config)
+    : mFd(::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644))
+    , mConfig(config)
+{
+    if (mFd < 0) {
+        throw std::runtime_error("Error: Cannot open " + path);
+    }
+    const off_t file_size = ::lseek(mFd, 0, SEEK_END);
+    mFileSize = file_size > 0 ? static_cast<uint64_t>(file_size) : 0;
+    mBuffer.reserve(mConfig.buffer_size + sizeof(JournalRecordHeader) + sizeof(protocol::Message));
+}
+
+JournalWriter::~JournalWriter() {
+    // Nowhere to report a failure from here
+    sync();
+    ::close(mFd);
+}
+
+bool JournalWriter::append(order::Sequence sequence, const protocol::Message& message) {
+    if (mFailed) return false;
+    appendRecord({JournalRecordKind::message, sizeof(protocol::Message), sequence}, &message, sizeof(protocol::Message));
+    if (mUncommitted++ == 0 && mConfig.sync_interval.count() > 0) {
+        mFirstUncommitted = std::chrono::steady_clock::now();
+    }
+    if (mConfig.sync_every_messages > 0 && mUncommitted >= mConfig.sync_every_messages) {
+        sync();
+    } else {
+        poll();
+    }
+    return !mFailed;
+}
+
+void JournalWriter::poll() {
+    if (mUncommitted > 0 && mConfig.sync_interval.count() > 0 &&
+        std::chrono::steady_clock::now() - mFirstUncommitted >= mConfig.sync_interval) {
+        sync();
+    }
+}
+
+bool JournalWriter::commitDeadline(std::chrono::steady_clock::time_point& deadline) const {
+    if (mUncommitted == 0 || mConfig.sync_interval.count() <= 0 || mFailed) return false;
+    deadline = mFirstUncommitted + mConfig.sync_interval;
+    return true;
+}
+
+void JournalWriter::appendSymbol(SymbolId id, std::string_view symbol) {
+    if (mFailed) return;
+    // The payload is the id followed by the name, both copied straight into the buffer
+    const JournalRecordHeader header {JournalRecordKind::symbol, static_cast<uint32_t>(sizeof(SymbolId) + symbol.size()), 0};
+    appendBytes(&header, sizeof(header));
+    appendBytes(&id, sizeof(SymbolId));
+    appendBytes(symbol.data(), symbol.size());
+    finishRecord();
+}
+
+void JournalWriter::appendMarker(JournalRecordKind kind) {
+    appendRecord({kind, 0, 0}, nullptr, 0);
+}
+
+void JournalWriter::appendRecord(const JournalRecordHeader& header, const void* payload, std::size_t payload_size) {
+    if (mFailed) return;
+    appendBytes(&header, sizeof(header));
+    appendBytes(payload, payload_size);
+    finishRecord();
+}
+
+void JournalWriter::appendBytes(const void* data, std::size_t size) {
+    if (size == 0) return;
+    const char* bytes = static_cast<const char*>(data);
+    mBuffer.insert(mBuffer.end(), bytes, bytes + size);
+}
+
+void JournalWriter::finishRecord() {
+    if (mBuffer.size() >= mConfig.buffer_size) writeBuffer();
+}
+
+void JournalWriter::writeBuffer() {
+    std::size_t written = 0;
+    while (!mFailed && written < mBuffer.size()) {
+        const ssize_t result = ::write(mFd, mBuffer.data() + written, mBuffer.size() - written);
+        if (result < 0) {
+            if (errno != EINTR) mFailed = true;
+            continue;
+        }
+        written += static_cast<std::size_t>(result);
+    }
+    mFileSize += written;
+    mBuffer.clear();
+}
+
+void JournalWriter::sync() {
+    writeBuffer();
+    if (!mFailed && ::fdatasync(mFd) != 0) mFailed = true;
+    if (!mFailed) mUncommitted = 0;
+}
+
+void JournalWriter::commit() {
+    sync();
+    if (mFailed) throw std::runtime_error("Error: Cannot write journal");
+}
+
+JournalReader::JournalReader(const std::string& path, uint64_t offset) {
+    struct stat file_stat;
+    if (::stat(path.c_str(), &file_stat) != 0 && errno == ENOENT) return;
+    // Mapped rather than read, so memory does not grow with the length of the session
+    mFile = std::make_unique<MappedFile>(path, MappedFile::Access::sequential);
+    mStart = std::min<uint64_t>(offset, mFile->size());
+    mData = mFile->view().substr(static_cast<std::size_t>(mStart));
+}
+
+bool JournalReader::next(JournalEntry& entry) {
+    JournalRecordHeader header;
+    if (mData.size() - mOffset < sizeof(header)) return false;
+    std::memcpy(&header, mData.data() + mOffset, sizeof(header));
+    if (mData.size() - mOffset - sizeof(header) < header.size) return false;
+    const char* payload = mData.data() + mOffset + sizeof(header);
+
+    switch (header.kind) {
+        case JournalRecordKind::message:
+            if (header.size != sizeof(protocol::Message)) throw std::runtime_error("Error: Corrupt journal");
+            std::memcpy(&entry.message, payload, sizeof(protocol::Message));
+            break;
+        case JournalRecordKind::symbol:
+            if (header.size < sizeof(SymbolId)) throw std::runtime_error("Error: Corrupt journal");
+            std::memcpy(&entry.symbol_id, payload, sizeof(SymbolId));
+            entry.symbol = std::string_view(payload + sizeof(SymbolId), header.size - sizeof(SymbolId));
+            break;
+        case JournalRecordKind::auction_begin:
+        case JournalRecordKind::auction_end:
+            if (header.size != 0) throw std::runtime_error("Error: Corrupt journal");
+            break;
+        default:
+            throw std::runtime_error("Error: Corrupt journal");
+    }
+    entry.kind = header.kind;
+    entry.sequence = header.sequence;
+    mOffset += sizeof(header) + header.size;
+    return true;
+}
+
+} // engine namespace
@@ -1,6 +1,200 @@
 #include "matching_engine.hpp"
 #include "main.hpp"
+#include "mapped_file.hpp"
+#include "string_utils.hpp"
+#include "trade_sink.hpp"
 
-int main() {
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <unistd.h>
+
+/*
+*  Usage: MatchingEngine [--binary] [--symbols SYMBOL,SYMBOL,...] [FILE]
+*
+*  Reads CSV commands, or protocol::Messages with --binary, from FILE or from stdin when there is
+*  no FILE or it is "-". Files are memory-mapped and parsed in place, stdin is read in large chunks,
+*  so the input is never copied into strings. Binary messages refer to symbols by id: --symbols
+*  registers the names in order, the first one gets id 0.
+*
+*  Trades and rejects are written to stdout as they happen, followed by the final books, in the same
+*  format processOrders() returns. A throughput report goes to stderr.
+*/
+
+namespace {
+    constexpr std::size_t io_buffer_size = 1 << 20;
+
+    struct Options {
+        bool binary = false;
+        std::string path {};
+        std::vector<std::string> symbols {};
+    };
+
+    Options parseOptions(int argc, char** argv) {
+        Options options;
+        for (int i = 1; i < argc; ++i) {
+            const std::string_view argument = argv[i];
+            if (argument == "--binary") {
+                options.binary = true;
+            } else if (argument == "--symbols" && i + 1 < argc) {
+                for (std::string_view names = argv[++i]; !names.empty();) {
+                    const std::size_t comma = names.find(',');
+                    options.symbols.emplace_back(names.substr(0, comma));
+                    names.remove_prefix(comma == std::string_view::npos ? names.size() : comma + 1);
+                }
+            } else if (options.path.empty() && (argument == "-" || argument.substr(0, 2) != "--")) {
+                options.path = argv[i];
+            } else {
+                throw std::invalid_argument(argv[i]);
+            }
+        }
+        return options;
+    }
+
+    /*! \brief Feeds raw input to the engine, in whatever pieces it arrives.
+    */
+    class InputProcessor {
+        public:
+            InputProcessor(MatchingEngine& matching_engine, engine::BufferedFileSink& sink, bool binary)
+                : mEngine(matching_engine)
+                , mSink(sink)
+                , mBinary(binary)
+            {}
+
+            /*!
+            *  \brief Applies every complete command at the start of `data`.
+            *
+            * \throws std::runtime_error if the output could not be written, no more input is taken then.
+            *
+            *   \ret Returns how many bytes were consumed, the rest has to be passed again with what follows.
+            */
+            std::size_t feed(std::string_view data) {
+                std::size_t consumed = 0;
+                if (mBinary) {
+                    consumed = data.size() - data.size() % sizeof(protocol::Message);
+                    protocol::Message message;
+                    for (std::size_t offset = 0; offset < consumed; offset += sizeof(protocol::Message)) {
+                        std::memcpy(&message, data.data() + offset, sizeof(protocol::Message));
+                        count(mEngine.processMessage(message));
+                    }
+                } else {
+                    for (std::size_t end = data.find('\n'); end != std::string_view::npos; end = data.find('\n', consumed)) {
+                        applyLine(data.substr(consumed, end - consumed));
+                        consumed = end + 1;
+                    }
+                }
+                // The sink only records a failed write while matching, reporting it is up to this loop
+                if (mSink.failed()) mSink.flush();
+                return consumed;
+            }
+
+            /*!
+            *  \brief Applies what `feed()` left over once the input has ended, i.e. a last line without newline.
+            */
+            void finish(std::string_view rest) {
+                if (rest.empty()) return;
+                if (mBinary) throw std::runtime_error("Error: Truncated binary message!");
+                applyLine(rest);
+            }
+
+            uint64_t commands() const { return mCommands; }
+            uint64_t rejects() const { return mRejects; }
+
+        private:
+            MatchingEngine& mEngine;
+            engine::BufferedFileSink& mSink;
+            bool mBinary;
+            uint64_t mCommands = 0;
+            uint64_t mRejects = 0;
+            engine::Command mCommand {};
+
+            void applyLine(std::string_view line) {
+                if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+                if (line.empty()) return;
+                const auto parsed = utils::parseCommand(line, mCommand);
+                count(mEngine.processCommand(mCommand, parsed));
+            }
+
+            void count(engine::RejectCode result) {
+                ++mCommands;
+                if (result != engine::RejectCode::none) ++mRejects;
+            }
+    };
+
+    uint64_t processFile(const std::string& path, InputProcessor& processor) {
+        const engine::MappedFile file(path, engine::MappedFile::Access::sequential);
+        const std::string_view data = file.view();
+        processor.finish(data.substr(processor.feed(data)));
+        return data.size();
+    }
+
+    uint64_t processStdin(InputProcessor& processor) {
+        std::vector<char> buffer(io_buffer_size);
+        std::size_t filled = 0;
+        uint64_t total = 0;
+        while (true) {
+            // Only a single line longer than the buffer makes it grow
+            if (filled == buffer.size()) buffer.resize(buffer.size() * 2);
+            const ssize_t count = ::read(STDIN_FILENO, buffer.data() + filled, buffer.size() - filled);
+            if (count < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error("Error: Cannot read stdin");
+            }
+            if (count == 0) break;
+            filled += static_cast<std::size_t>(count);
+            total += static_cast<uint64_t>(count);
+            const std::size_t consumed = processor.feed({buffer.data(), filled});
+            std::memmove(buffer.data(), buffer.data() + consumed, filled - consumed);
+            filled -= consumed;
+        }
+        processor.finish({buffer.data(), filled});
+        return total;
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    try {
+        options = parseOptions(argc, argv);
+    } catch (const std::invalid_argument& error) {
+        std::fprintf(stderr, "Invalid argument: %s\n"
+                             "Usage: %s [--binary] [--symbols SYMBOL,SYMBOL,...] [FILE]\n", error.what(), argv[0]);
+        return 2;
+    }
+
+    engine::BufferedFileSink sink(stdout, io_buffer_size);
+    MatchingEngine matchingEngine(sink);
+    for (const auto& symbol: options.symbols) matchingEngine.registerSymbol(symbol);
+    InputProcessor processor(matchingEngine, sink, options.binary);
+
+    const auto start = std::chrono::steady_clock::now();
+    uint64_t bytes = 0;
+    try {
+        bytes = options.path.empty() || options.path == "-" ? processStdin(processor) : processFile(options.path, processor);
+        sink.flush();
+    } catch (const std::runtime_error& error) {
+        std::fprintf(stderr, "%s (command %llu)\n", error.what(), static_cast<unsigned long long>(processor.commands()));
+        return 1;
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::string books;
+    for (const auto& line: matchingEngine.snapshot()) {
+        books.append(line);
+        books.push_back('\n');
+    }
+    std::fwrite(books.data(), 1, books.size(), stdout);
+    std::fflush(stdout);
+
+    const double seconds = elapsed.count() > 0 ? elapsed.count() : 1e-9;
+    std::fprintf(stderr, "Processed %llu commands (%llu rejected), %.1f MB in %.3f s: %.0f commands/s, %.1f MB/s\n",
+                 static_cast<unsigned long long>(processor.commands()), static_cast<unsigned long long>(processor.rejects()),
+                 bytes / 1e6, elapsed.count(), processor.commands() / seconds, bytes / 1e6 / seconds);
     return 0;
-}
\ No newline at end of file
+}
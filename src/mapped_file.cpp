@@ -0,0 +1,44 @@
+#include "mapped_file.hpp"
+
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace engine {
+
+MappedFile::MappedFile(const std::string& path, Access access) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Error: Cannot open " + path);
+    }
+    struct stat file_stat;
+    if (::fstat(fd, &file_stat) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Error: Cannot read " + path);
+    }
+    mSize = static_cast<std::size_t>(file_stat.st_size);
+    if (mSize > 0) {
+        const int flags = access == Access::random ? MAP_PRIVATE | MAP_POPULATE : MAP_PRIVATE;
+        void* mapping = ::mmap(nullptr, mSize, PROT_READ, flags, fd, 0);
+        if (mapping == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error("Error: Cannot map " + path);
+        }
+        if (access == Access::sequential) {
+            // Only a hint, nothing to do if it is refused
+            ::madvise(mapping, mSize, MADV_SEQUENTIAL);
+        }
+        mData = static_cast<const char*>(mapping);
+    }
+    // The mapping stays valid without the descriptor
+    ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (mData) ::munmap(const_cast<char*>(mData), mSize);
+}
+
+} // engine namespace
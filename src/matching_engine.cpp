@@ -1,224 +1,708 @@
 #include "matching_engine.hpp"
 #include "string_utils.hpp"
 
-#include <chrono>
 #include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
 
+#include <unistd.h>
+
+
+MatchingEngine::MatchingEngine(const engine::EngineConfig& config)
+    : mConfig(config)
+    , mOrderPool(config.max_open_orders)
+    , mOrderIndex(config.max_open_orders)
+{}
+
+MatchingEngine::MatchingEngine(engine::TradeSink& sink, const engine::EngineConfig& config)
+    : MatchingEngine(config)
+{
+    mSink = &sink;
+}
+
+namespace {
+    // Holds back level updates while a batch is applied, they go out once the outermost batch is done
+    class BatchScope {
+        public:
+            explicit BatchScope(uint32_t& depth) : mDepth(depth) { ++mDepth; }
+            ~BatchScope() { --mDepth; }
+            BatchScope(const BatchScope&) = delete;
+            BatchScope& operator=(const BatchScope&) = delete;
+
+        private:
+            uint32_t& mDepth;
+    };
+}
 
 std::vector<std::string> MatchingEngine::processOrders(const std::vector<std::string>& input) {
     if (input.empty()) return {};
-    for (const auto& command: input) {
-        auto command_arguments = utils::splitCommands(command);
-        if (command_arguments.empty()) {
-            throw std::runtime_error("Error: Invalid command!");
+    {
+        const BatchScope batch(mBatchDepth);
+        engine::Command command;
+        for (const auto& line: input) {
+            const auto parsed = utils::parseCommand(line, command);
+            processCommand(command, parsed);
         }
-        if (command_arguments.at(0) == "INSERT") {
-            insert_order(command_arguments);
-        } else if (command_arguments.at(0) == "AMEND") {
-            amend_order(command_arguments);
-        } else if (command_arguments.at(0) == "PULL") {
-            pullOrder(std::stoi(command_arguments.at(1)));
+    }
+    publishChanges();
+    return getFinalResult();
+}
+
+std::vector<std::string> MatchingEngine::processBatch(std::string_view input, engine::BatchMode mode) {
+    engine::CommandBlock block;
+    parseBatch(input, block);
+    if (block.size() == 0) return {};
+    applyBatch(block, mode);
+    return getFinalResult();
+}
+
+void MatchingEngine::parseBatch(std::string_view input, engine::CommandBlock& block) {
+    block.clear();
+    block.reserve(static_cast<std::size_t>(std::count(input.begin(), input.end(), '\n')) + 1);
+    engine::Command command;
+    while (!input.empty()) {
+        const std::size_t end = input.find('\n');
+        std::string_view line = input.substr(0, end);
+        input.remove_prefix(end == std::string_view::npos ? input.size() : end + 1);
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        if (line.empty()) continue;
+        const auto parsed = utils::parseCommand(line, command);
+        if (parsed == engine::RejectCode::none) {
+            block.push_back(toMessage(command));
         } else {
-            throw std::runtime_error("Error: Invalid command!");
+            block.pushRejected(command.type, command.id, parsed);
+        }
+    }
+}
+
+void MatchingEngine::applyBatch(const engine::CommandBlock& block, engine::BatchMode mode) {
+    {
+        const BatchScope batch(mBatchDepth);
+        if (mode == engine::BatchMode::auction) beginAuction();
+        for (std::size_t i = 0; i < block.size(); ++i) {
+            applyCommand(block, i);
+        }
+        if (mode == engine::BatchMode::auction) endAuction();
+    }
+    publishChanges();
+}
+
+std::vector<std::string> MatchingEngine::processMessages(const char* data, std::size_t size) {
+    if (size % sizeof(protocol::Message) != 0) {
+        throw std::runtime_error("Error: Truncated binary message!");
+    }
+    if (size == 0) return {};
+    {
+        const BatchScope batch(mBatchDepth);
+        protocol::Message message;
+        for (const char* end = data + size; data != end; data += sizeof(protocol::Message)) {
+            // The buffer may not be aligned for Message
+            std::memcpy(&message, data, sizeof(protocol::Message));
+            processMessage(message);
         }
-    }       
+    }
+    publishChanges();
     return getFinalResult();
 }
 
-void MatchingEngine::insert_order(const std::vector<std::string>& command_arguments) {
-    order::Id orderId = std::stoul(command_arguments.at(1));
-    std::string symbol = command_arguments.at(2);
-    order::Side side = command_arguments.at(3) == "BUY" ? order::Side::buy : order::Side::sell;
-    double price = std::stod(command_arguments.at(4));
-    int volume = std::stoi(command_arguments.at(5));
-    if (utils::isValidPrice(command_arguments.at(4)) && mActiveOrderIds.find(orderId) == mActiveOrderIds.end()) {
-        addOrder(symbol, {orderId, side, price, volume});
-    } else throw std::runtime_error("Error: Invalid INSERT command!");
+engine::SymbolId MatchingEngine::registerSymbol(std::string_view symbol) {
+    const auto known_symbols = mSymbols.size();
+    const auto id = mSymbols.intern(symbol);
+    if (mJournal && mSymbols.size() != known_symbols) {
+        mJournal->appendSymbol(id, symbol);
+    }
+    return id;
 }
 
-void MatchingEngine::amend_order(const std::vector<std::string>& command_arguments) {
-    order::Id orderId = std::stoul(command_arguments.at(1));
-    double price = std::stod(command_arguments.at(2));
-    int volume = std::stoi(command_arguments.at(3));
-    if (utils::isValidPrice(command_arguments.at(2))) {
-        amendOrder(orderId, price, volume);
-    } else throw std::runtime_error("Error: Invalid AMEND command!");
+void MatchingEngine::setJournal(engine::JournalWriter* journal) {
+    mJournal = journal;
+    if (!mJournal) return;
+    // Replaying a symbol that is already registered is harmless, so they can be written again
+    for (engine::SymbolId id = 0; id < mSymbols.size(); ++id) {
+        mJournal->appendSymbol(id, mSymbols.name(id));
+    }
 }
 
-void MatchingEngine::addOrder(const std::string& symbol, Order order) {
-    if (!mClob[symbol]) {
-        mClob[symbol] = std::make_unique<engine::TradeNode>();
+void MatchingEngine::poll() {
+    if (mJournal) mJournal->poll();
+}
+
+bool MatchingEngine::pollDeadline(std::chrono::steady_clock::time_point& deadline) const {
+    return mJournal && mJournal->commitDeadline(deadline);
+}
+
+void MatchingEngine::setBookPublisher(engine::SharedBookPublisher* publisher) {
+    for (engine::TradeNode* node: mChangedBooks) node->publish_pending = false;
+    mChangedBooks.clear();
+    mPublisher = publisher;
+    if (!mPublisher) return;
+    mChangedBooks.reserve(mPublisher->maxSymbols());
+    for (const auto& node: mClob) {
+        if (node && node->symbol_id < mPublisher->maxSymbols()) {
+            mPublisher->publish(*node, mSymbols.name(node->symbol_id), mSequence);
+        }
     }
-    if (order.side == order::Side::buy) {
-        mClob[symbol]->buy_orders.insert(order);
-    } else {
-        mClob[symbol]->sell_orders.insert(order);
-    }
-    mActiveOrderIds.insert(order.id);
-    processCurrentOrders();
-}
-
-void MatchingEngine::pullOrder(order::Id id) {
-    if (!mClob.empty()) {
-        for (auto& node: mClob) {
-            auto idsEqual = [&](Order order){
-                if (order.id == id) return true; 
-                return false;
-            };
-            // Look for the id in the buy orders
-            const auto& buy_trade_it = std::find_if(node.second->buy_orders.begin(),
-                                                    node.second->buy_orders.end(), idsEqual);
-            if (buy_trade_it != node.second->buy_orders.end()) {
-                node.second->buy_orders.erase(*buy_trade_it);
-                mActiveOrderIds.erase(buy_trade_it->id);
-                processCurrentOrders();
-                return;
+}
+
+engine::ReplayResult MatchingEngine::replay(const std::string& journal_path, uint64_t journal_offset) {
+    engine::JournalReader reader(journal_path, journal_offset);
+    engine::ReplayResult result;
+    engine::JournalWriter* journal = mJournal;
+    mJournal = nullptr;
+    engine::JournalEntry entry;
+    {
+        // The whole replay is one batch, a subscriber gets the levels it changed at the end
+        const BatchScope batch(mBatchDepth);
+        while (reader.next(entry)) {
+            if (entry.kind == engine::JournalRecordKind::symbol) {
+                if (registerSymbol(entry.symbol) != entry.symbol_id) {
+                    throw std::runtime_error("Error: Corrupt journal " + journal_path);
+                }
+                continue;
+            }
+            if (entry.kind == engine::JournalRecordKind::auction_begin) {
+                beginAuction();
+                continue;
             }
-            // Look for the id in the sell orders
-            const auto& sell_trade_it = std::find_if(node.second->sell_orders.begin(),
-                                                     node.second->sell_orders.end(), idsEqual);
-            if (sell_trade_it != node.second->sell_orders.end()) {
-                node.second->buy_orders.erase(*sell_trade_it);
-                mActiveOrderIds.erase(sell_trade_it->id);
-                processCurrentOrders();
-                return;
+            if (entry.kind == engine::JournalRecordKind::auction_end) {
+                endAuction();
+                continue;
             }
+            if (entry.sequence <= result.last_sequence) {
+                throw std::runtime_error("Error: Corrupt journal " + journal_path);
+            }
+            result.last_sequence = entry.sequence;
+            // Already part of the state
+            if (entry.sequence <= mSequence) continue;
+            // A message rejected the first time is rejected again, the same way
+            processMessage(entry.message, entry.sequence);
+            ++result.messages;
         }
+        // The crash came in the middle of an auction batch, the books must not stay crossed
+        if (mDeferMatching) endAuction();
+    }
+    mJournal = journal;
+    publishChanges();
+
+    result.dropped_bytes = reader.fileSize() - reader.validSize();
+    if (result.dropped_bytes > 0 && ::truncate(journal_path.c_str(), static_cast<off_t>(reader.validSize())) != 0) {
+        throw std::runtime_error("Error: Cannot truncate " + journal_path);
+    }
+    return result;
+}
+
+bool MatchingEngine::findSymbol(std::string_view symbol, engine::SymbolId& id) const {
+    return mSymbols.find(symbol, id);
+}
+
+engine::RejectCode MatchingEngine::processCommand(const engine::Command& command, engine::RejectCode parsed) {
+    if (parsed != engine::RejectCode::none) return rejectUnparsed(command.type, command.id, parsed);
+    return processMessage(toMessage(command));
+}
+
+engine::RejectCode MatchingEngine::rejectUnparsed(engine::CommandType type, order::Id id, engine::RejectCode code) {
+    const order::Sequence sequence = mSequence + 1;
+    // Journaled as an invalid message: it uses up its sequence number and replays as a reject
+    const bool journaled = !mJournal || mJournal->append(sequence, protocol::makeInvalid(id));
+    mSequence = sequence;
+    return completeCommand(type, id, journaled ? code : engine::RejectCode::journal_error, mStats.startTimer());
+}
+
+protocol::Message MatchingEngine::toMessage(const engine::Command& command) {
+    switch (command.type) {
+        case engine::CommandType::insert:
+            return protocol::makeInsert(command.id, registerSymbol(command.symbol), command.side, command.price, command.volume);
+        case engine::CommandType::amend:
+            return protocol::makeAmend(command.id, command.price, command.volume);
+        case engine::CommandType::pull:
+            return protocol::makePull(command.id);
+        default:
+            return {};
+    }
+}
+
+engine::RejectCode MatchingEngine::processMessage(const protocol::Message& message) {
+    return processMessage(message, mSequence + 1);
+}
+
+engine::RejectCode MatchingEngine::processMessage(const protocol::Message& message, order::Sequence sequence) {
+    // Write-ahead: a message is on its way to disk before it changes anything
+    const bool journaled = !mJournal || mJournal->append(sequence, message);
+    mSequence = sequence;
+    const auto timer = mStats.startTimer();
+    if (!journaled) return completeCommand(message.type, message.id, engine::RejectCode::journal_error, timer);
+    engine::RejectCode result;
+    switch (message.type) {
+        case engine::CommandType::insert:
+            result = insert_order(message.id, message.symbol, message.side, message.price, message.volume);
+            break;
+        case engine::CommandType::amend:
+            result = amendOrder(message.id, message.price, message.volume);
+            break;
+        case engine::CommandType::pull:
+            result = pullOrder(message.id);
+            break;
+        default:
+            result = engine::RejectCode::malformed;
+    }
+    return completeCommand(message.type, message.id, result, timer);
+}
+
+engine::RejectCode MatchingEngine::applyCommand(const engine::CommandBlock& block, std::size_t index) {
+    if (block.rejects[index] != engine::RejectCode::none) {
+        return rejectUnparsed(block.types[index], block.ids[index], block.rejects[index]);
+    }
+    const order::Sequence sequence = mSequence + 1;
+    // Only the journal needs the whole message, the matcher reads the columns the command type uses
+    const bool journaled = !mJournal || mJournal->append(sequence, block.message(index));
+    mSequence = sequence;
+    const auto timer = mStats.startTimer();
+    const engine::CommandType type = block.types[index];
+    const order::Id id = block.ids[index];
+    if (!journaled) return completeCommand(type, id, engine::RejectCode::journal_error, timer);
+    engine::RejectCode result;
+    switch (type) {
+        case engine::CommandType::insert:
+            result = insert_order(id, block.symbols[index], block.sides[index], block.prices[index], block.volumes[index]);
+            break;
+        case engine::CommandType::amend:
+            result = amendOrder(id, block.prices[index], block.volumes[index]);
+            break;
+        case engine::CommandType::pull:
+            result = pullOrder(id);
+            break;
+        default:
+            result = engine::RejectCode::malformed;
+    }
+    return completeCommand(type, id, result, timer);
+}
+
+engine::RejectCode MatchingEngine::completeCommand(engine::CommandType type, order::Id id, engine::RejectCode result,
+                                                   engine::EngineStats::Timer timer) {
+    if (result == engine::RejectCode::none) {
+        mStats.recordLatency(type, timer);
+        mStats.onRestingOrders(mOrderIndex.size());
+    } else {
+        mStats.onReject();
+        mSink->onReject({type, result, id});
+    }
+    // A command on its own is a batch of one
+    publishChanges();
+    return result;
+}
+
+engine::RejectCode MatchingEngine::insert_order(order::Id id, engine::SymbolId symbol, order::Side side, order::Price price, int volume) {
+    if (side != order::Side::buy && side != order::Side::sell) return engine::RejectCode::invalid_side;
+    if (volume <= 0) return engine::RejectCode::invalid_volume;
+    if (!order::isValidPrice(price)) return engine::RejectCode::invalid_price;
+    if (!mSymbols.contains(symbol)) return engine::RejectCode::unknown_symbol;
+    if (mOrderIndex.contains(id)) return engine::RejectCode::duplicate_id;
+    addOrder(symbol, {id, side, price, volume});
+    return engine::RejectCode::none;
+}
+
+void MatchingEngine::addOrder(engine::SymbolId symbol, const Order& order) {
+    if (symbol >= mClob.size()) {
+        mClob.resize(mSymbols.size());
+    }
+    auto& node = mClob[symbol];
+    if (!node) {
+        node = std::make_unique<engine::TradeNode>(symbol, bookLayout());
+    }
+    Order* incoming_order = mOrderPool.allocate(order, {order.volume, mSequence, 0});
+    mOrderIndex.insert(order.id, {node.get(), incoming_order});
+    matchOrder(*node, incoming_order);
+}
+
+template <order::Side Side>
+void MatchingEngine::levelChanged(engine::TradeNode& node, order::Price price) {
+    // Books past the publisher's capacity are not published, so the list never outgrows its reservation
+    if (mPublisher && !node.publish_pending && node.symbol_id < mPublisher->maxSymbols()) {
+        node.publish_pending = true;
+        mChangedBooks.push_back(&node);
+    }
+    if (!mConfig.level_updates) return;
+    // Fills work through one level at a time, so most repeats come back to back
+    if (!mChangedLevels.empty()) {
+        const auto& last = mChangedLevels.back();
+        if (last.price == price && last.side == Side && last.symbol == node.symbol_id) return;
+    }
+    mChangedLevels.push_back({node.symbol_id, Side, price});
+}
+
+void MatchingEngine::publishChanges() {
+    if (mBatchDepth != 0) return;
+    for (engine::TradeNode* node: mChangedBooks) {
+        node->publish_pending = false;
+        mPublisher->publish(*node, mSymbols.name(node->symbol_id), mSequence);
+    }
+    mChangedBooks.clear();
+    if (mChangedLevels.empty()) return;
+    // One update per level, in symbol, side and price order
+    std::sort(mChangedLevels.begin(), mChangedLevels.end(), [](const engine::ChangedLevel& lhs, const engine::ChangedLevel& rhs) {
+        return std::tie(lhs.symbol, lhs.side, lhs.price) < std::tie(rhs.symbol, rhs.side, rhs.price);
+    });
+    const auto end = std::unique(mChangedLevels.begin(), mChangedLevels.end(), [](const engine::ChangedLevel& lhs, const engine::ChangedLevel& rhs) {
+        return lhs.symbol == rhs.symbol && lhs.side == rhs.side && lhs.price == rhs.price;
+    });
+    for (auto changed = mChangedLevels.begin(); changed != end; ++changed) {
+        const engine::TradeNode& node = *mClob[changed->symbol];
+        const engine::PriceLevel* level = changed->side == order::Side::buy ? node.buy_orders.level(changed->price)
+                                                                              : node.sell_orders.level(changed->price);
+        mSink->onLevelUpdate({changed->symbol, changed->side, changed->price, level ? level->volume : 0,
+                              level ? level->order_count : 0, mSequence});
+    }
+    mChangedLevels.clear();
+}
+
+template <order::Side Side>
+void MatchingEngine::linkOrder(engine::TradeNode& node, Order* order) {
+    if (node.book<Side>().insert(order)) mStats.onLevelAdded(Side);
+    levelChanged<Side>(node, order->price);
+}
+
+template <order::Side Side>
+void MatchingEngine::unlinkOrder(engine::TradeNode& node, Order* order) {
+    if (node.book<Side>().erase(order)) mStats.onLevelRemoved(Side);
+    levelChanged<Side>(node, order->price);
+}
+
+template <order::Side Side>
+void MatchingEngine::reduceOrder(engine::TradeNode& node, Order* order, int filled) {
+    node.book<Side>().reduce(order, filled);
+    levelChanged<Side>(node, order->price);
+}
+
+template <order::Side Side>
+void MatchingEngine::eraseOrder(engine::OrderLocation location) {
+    // Taken by value: erasing from the index may shift another entry into the slot `location` came from
+    unlinkOrder<Side>(*location.node, location.order);
+    mOrderIndex.erase(location.order->id);
+    mOrderPool.deallocate(location.order);
+}
+
+void MatchingEngine::linkOrder(engine::TradeNode& node, Order* order) {
+    if (order->side == order::Side::buy) {
+        linkOrder<order::Side::buy>(node, order);
+    } else {
+        linkOrder<order::Side::sell>(node, order);
+    }
+}
+
+void MatchingEngine::unlinkOrder(engine::TradeNode& node, Order* order) {
+    if (order->side == order::Side::buy) {
+        unlinkOrder<order::Side::buy>(node, order);
+    } else {
+        unlinkOrder<order::Side::sell>(node, order);
     }
-    throw std::runtime_error(std::string("Error: Cannot pull order #" + std::to_string(id)));
-}
-
-bool MatchingEngine::amend(std::set<Order>& order_set, const std::string& symbol, order::Id id, double price, int volume) {
-    const auto& trade_it = std::find_if(order_set.begin(), 
-                                        order_set.end(), 
-                                        [&](Order order) {
-                                                            if (order.id == id) 
-                                                                return true; 
-                                                            return false;
-                                                        });
-    if (trade_it != order_set.end()) {
-        auto old_id = trade_it->id;
-        auto old_side = trade_it->side;
-        auto old_timestamp = trade_it->timestamp;
-        if (trade_it->price == price && trade_it->volume > volume) {
-            order_set.erase(*trade_it);
-            addOrder(symbol, {old_id, old_side, price, volume, old_timestamp});
+}
+
+void MatchingEngine::eraseOrder(engine::OrderLocation location) {
+    if (location.order->side == order::Side::buy) {
+        eraseOrder<order::Side::buy>(location);
+    } else {
+        eraseOrder<order::Side::sell>(location);
+    }
+}
+
+engine::RejectCode MatchingEngine::pullOrder(order::Id id) {
+    const auto* location = mOrderIndex.find(id);
+    if (location == nullptr) return engine::RejectCode::unknown_order;
+    // Removing liquidity can not make the book cross, nothing to match
+    eraseOrder(*location);
+    mStats.onCancel();
+    return engine::RejectCode::none;
+}
+
+void MatchingEngine::amend(const engine::OrderLocation& location, order::Price price, int volume) {
+    Order* order = location.order;
+    // Before matching, which may fill the order and free its slot
+    mOrderPool.details(order).amended = mSequence;
+    if (order->price == price && order->volume > volume) {
+        // Keeps its place in the queue, and a smaller order can not cross
+        if (order->side == order::Side::buy) {
+            reduceOrder<order::Side::buy>(*location.node, order, order->volume - volume);
         } else {
-            order_set.erase(*trade_it);
-            auto new_ts = std::chrono::system_clock::now().time_since_epoch().count();
-            addOrder(symbol, {old_id, old_side, price, volume, new_ts, new_ts});
+            reduceOrder<order::Side::sell>(*location.node, order, order->volume - volume);
         }
-        return true;
+        order->last_updated = 0;
+    } else {
+        // Loses its priority, it is matched again as if it just arrived
+        unlinkOrder(*location.node, order);
+        order->price = price;
+        order->volume = volume;
+        order->last_updated = mSequence;
+        matchOrder(*location.node, order);
     }
-    return false;
 }
 
-void MatchingEngine::amendOrder(order::Id id, double price, int volume) {
-    if (!mClob.empty()) {
-        for (auto& node: mClob) {
-            if (!amend(node.second->buy_orders, node.first, id, price, volume) && 
-                !amend(node.second->sell_orders, node.first, id, price, volume)) {
-                    throw std::runtime_error(std::string("Error: Cannot amend order #" + std::to_string(id)));
-                }
+engine::RejectCode MatchingEngine::amendOrder(order::Id id, order::Price price, int volume) {
+    if (volume <= 0) return engine::RejectCode::invalid_volume;
+    if (!order::isValidPrice(price)) return engine::RejectCode::invalid_price;
+    const auto* location = mOrderIndex.find(id);
+    if (location == nullptr) return engine::RejectCode::unknown_order;
+    amend(engine::OrderLocation(*location), price, volume);
+    return engine::RejectCode::none;
+}
+
+void MatchingEngine::matchOrder(engine::TradeNode& node, Order* incoming_order) {
+    if (mDeferMatching) {
+        linkOrder(node, incoming_order);
+        if (!node.uncross_pending) {
+            node.uncross_pending = true;
+            mPendingUncross.push_back(&node);
         }
+        return;
+    }
+    // The only check of the side, the rest of the match is compiled once for each one
+    if (incoming_order->side == order::Side::buy) {
+        matchIncoming<order::Side::buy>(node, incoming_order);
+    } else {
+        matchIncoming<order::Side::sell>(node, incoming_order);
     }
 }
 
-void MatchingEngine::processCurrentOrders() {
-    for (const auto& node: mClob) {
-        while (!node.second->buy_orders.empty() && !node.second->sell_orders.empty() && (
-               std::prev(node.second->buy_orders.end())->price >= node.second->sell_orders.begin()->price
-            )) {
-                const auto& buy_order = std::prev(node.second->buy_orders.end()); // Best bid
-                const auto& sell_order = node.second->sell_orders.begin(); // Lowest ask
-                order::Id agressive_order_id = sell_order->id;
-                order::Id passive_order_id = buy_order->id;
-                if (buy_order->last_updated > sell_order->last_updated) {
-                    std::swap(agressive_order_id, passive_order_id);
-                }
-                if (buy_order->volume == sell_order->volume) {
-                    node.second->buy_orders.erase(buy_order);
-                    node.second->sell_orders.erase(sell_order);
-                    addTradeToHistory(node.first, buy_order->price, sell_order->volume, agressive_order_id, passive_order_id);
-                } else if (buy_order->volume > sell_order->volume) {
-                    Order updated_buy_order(*buy_order);
-                    int stocks_exchanged = buy_order->volume - sell_order->volume;
-                    updated_buy_order.volume = stocks_exchanged;
-                    node.second->buy_orders.erase(buy_order);
-                    node.second->buy_orders.insert(updated_buy_order);
-                    node.second->sell_orders.erase(sell_order);
-                    addTradeToHistory(node.first, buy_order->price, sell_order->volume, agressive_order_id, passive_order_id);
-                } else {
-                    Order updated_sell_order(*sell_order);
-                    updated_sell_order.volume = sell_order->volume - buy_order->volume;
-                    node.second->sell_orders.erase(sell_order);
-                    node.second->sell_orders.insert(updated_sell_order);
-                    node.second->buy_orders.erase(buy_order);                   
-                    addTradeToHistory(node.first, buy_order->price, buy_order->volume, agressive_order_id, passive_order_id);
-                }
-            }
+template <order::Side Side>
+void MatchingEngine::matchIncoming(engine::TradeNode& node, Order* incoming_order) {
+    using Traits = engine::SideTraits<Side>;
+    constexpr bool is_buy = Side == order::Side::buy;
+    auto& opposite_orders = node.book<Traits::opposite>();
+    uint64_t fills = 0;
+    while (incoming_order->volume > 0 && !opposite_orders.empty()) {
+        mStats.onMatchIteration();
+        Order* resting_order = opposite_orders.best();
+        if (!Traits::crosses(incoming_order->price, resting_order->price)) break;
+        Order* buy_order = is_buy ? incoming_order : resting_order;
+        Order* sell_order = is_buy ? resting_order : incoming_order;
+
+        order::Id agressive_order_id = sell_order->id;
+        order::Id passive_order_id = buy_order->id;
+        if (buy_order->last_updated > sell_order->last_updated) {
+            std::swap(agressive_order_id, passive_order_id);
+        }
+        const order::Price price = buy_order->price;
+        const int stocks_exchanged = std::min(buy_order->volume, sell_order->volume);
+        incoming_order->volume -= stocks_exchanged;
+        reduceOrder<Traits::opposite>(node, resting_order, stocks_exchanged);
+        if (resting_order->volume == 0) eraseOrder<Traits::opposite>({&node, resting_order});
+        addTradeToHistory(node, price, stocks_exchanged, agressive_order_id, passive_order_id);
+        ++fills;
+    }
+    mStats.onAggressorDone(fills);
+    if (incoming_order->volume > 0) {
+        linkOrder<Side>(node, incoming_order);
+    } else {
+        mOrderIndex.erase(incoming_order->id);
+        mOrderPool.deallocate(incoming_order);
     }
 }
 
-void MatchingEngine::addTradeToHistory(const std::string& symbol, double price, int volume , order::Id agressive_id, order::Id passive_id) {
-    std::string trade(symbol);
-    trade.append(",");
-    trade.append(utils::dropTrailingZeroes(std::to_string(price)));
-    trade.append(",");
-    trade.append(std::to_string(volume));
-    trade.append(",");
-    trade.append(std::to_string(agressive_id));
-    trade.append(",");
-    trade.append(std::to_string(passive_id));
-    mListOfTrades.push_back(trade);
+void MatchingEngine::beginAuction() {
+    if (mJournal) mJournal->appendMarker(engine::JournalRecordKind::auction_begin);
+    mDeferMatching = true;
+}
+
+void MatchingEngine::endAuction() {
+    mDeferMatching = false;
+    // Uncross in symbol id order, so the trades come out the same on replay
+    std::sort(mPendingUncross.begin(), mPendingUncross.end(), [](const engine::TradeNode* lhs, const engine::TradeNode* rhs) {
+        return lhs->symbol_id < rhs->symbol_id;
+    });
+    for (engine::TradeNode* node: mPendingUncross) {
+        node->uncross_pending = false;
+        uncross(*node);
+    }
+    mPendingUncross.clear();
+    if (mJournal) mJournal->appendMarker(engine::JournalRecordKind::auction_end);
+    mStats.onRestingOrders(mOrderIndex.size());
+}
+
+void MatchingEngine::uncross(engine::TradeNode& node) {
+    auto& bids = node.buy_orders;
+    auto& asks = node.sell_orders;
+    if (bids.empty() || asks.empty() || !engine::SideTraits<order::Side::buy>::crosses(bids.bestPrice(), asks.bestPrice())) return;
+    const order::Price best_bid = bids.bestPrice();
+    const order::Price best_ask = asks.bestPrice();
+
+    // Volume of every level that crosses, best first, and every price the auction could clear at
+    std::vector<engine::DepthLevel> bid_levels;
+    std::vector<engine::DepthLevel> ask_levels;
+    std::vector<order::Price> candidates;
+    const auto collect = [&candidates](const auto& side, std::vector<engine::DepthLevel>& out, order::Price opposite_best) {
+        using Traits = typename std::decay_t<decltype(side)>::Traits;
+        side.forEachLevel([&](const engine::PriceLevel& level) {
+            if (!Traits::crosses(level.price, opposite_best)) return false;
+            out.push_back({level.price, level.volume, level.order_count});
+            candidates.push_back(level.price);
+            return true;
+        });
+    };
+    collect(bids, bid_levels, best_ask);
+    collect(asks, ask_levels, best_bid);
+    std::sort(candidates.begin(), candidates.end());
+
+    int64_t total_demand = 0;
+    for (const auto& level: bid_levels) total_demand += level.volume;
+    // Walk the candidates upwards: supply grows as asks become executable, demand shrinks as bids drop out
+    std::size_t next_ask = 0;
+    std::size_t next_bid = bid_levels.size();
+    int64_t supply = 0;
+    int64_t demand = total_demand;
+    order::Price clearing_price = best_ask;
+    int64_t clearing_volume = -1;
+    int64_t clearing_surplus = 0;
+    for (const order::Price price: candidates) {
+        while (next_ask < ask_levels.size() && ask_levels[next_ask].price <= price) supply += ask_levels[next_ask++].volume;
+        while (next_bid > 0 && bid_levels[next_bid - 1].price < price) demand -= bid_levels[--next_bid].volume;
+        const int64_t volume = std::min(demand, supply);
+        const int64_t surplus = demand > supply ? demand - supply : supply - demand;
+        if (volume > clearing_volume || (volume == clearing_volume && surplus < clearing_surplus)) {
+            clearing_price = price;
+            clearing_volume = volume;
+            clearing_surplus = surplus;
+        }
+    }
+
+    uint64_t fills = 0;
+    while (clearing_volume > 0) {
+        mStats.onMatchIteration();
+        Order* buy_order = bids.best();
+        Order* sell_order = asks.best();
+        order::Id agressive_order_id = sell_order->id;
+        order::Id passive_order_id = buy_order->id;
+        if (buy_order->last_updated > sell_order->last_updated) {
+            std::swap(agressive_order_id, passive_order_id);
+        }
+        const int stocks_exchanged = static_cast<int>(std::min<int64_t>({buy_order->volume, sell_order->volume, clearing_volume}));
+        reduceOrder<order::Side::buy>(node, buy_order, stocks_exchanged);
+        reduceOrder<order::Side::sell>(node, sell_order, stocks_exchanged);
+        clearing_volume -= stocks_exchanged;
+        if (buy_order->volume == 0) eraseOrder<order::Side::buy>({&node, buy_order});
+        if (sell_order->volume == 0) eraseOrder<order::Side::sell>({&node, sell_order});
+        addTradeToHistory(node, clearing_price, stocks_exchanged, agressive_order_id, passive_order_id);
+        ++fills;
+    }
+    mStats.onUncrossDone(fills);
+}
+
+void MatchingEngine::addTradeToHistory(const engine::TradeNode& node, order::Price price, int volume , order::Id agressive_id, order::Id passive_id) {
+    mSink->onTrade({node.symbol_id, mSymbols.name(node.symbol_id), price, volume, agressive_id, passive_id});
 }
 
 std::vector<std::string> MatchingEngine::getFinalResult() {
-    std::vector<std::string> result(mListOfTrades);
+    // Trades only end up in the result when no sink was given to the engine
+    std::vector<std::string> result = mStringSink.take();
+    appendSnapshot(result, std::numeric_limits<std::size_t>::max());
+    return result;
+}
+
+bool MatchingEngine::depth(std::string_view symbol, std::size_t max_levels, engine::BookDepth& out) const {
+    engine::SymbolId symbol_id;
+    if (!mSymbols.find(symbol, symbol_id)) {
+        out.bids.clear();
+        out.asks.clear();
+        return false;
+    }
+    return depth(symbol_id, max_levels, out);
+}
+
+bool MatchingEngine::depth(engine::SymbolId symbol, std::size_t max_levels, engine::BookDepth& out) const {
+    out.bids.clear();
+    out.asks.clear();
+    if (symbol >= mClob.size() || !mClob[symbol]) return false;
+    mClob[symbol]->buy_orders.depth(max_levels, out.bids);
+    mClob[symbol]->sell_orders.depth(max_levels, out.asks);
+    return true;
+}
+
+bool MatchingEngine::topOfBook(std::string_view symbol, engine::TopOfBook& out) const {
+    engine::SymbolId symbol_id;
+    if (!mSymbols.find(symbol, symbol_id)) {
+        out = {};
+        return false;
+    }
+    return topOfBook(symbol_id, out);
+}
+
+bool MatchingEngine::topOfBook(engine::SymbolId symbol, engine::TopOfBook& out) const {
+    out = {};
+    if (symbol >= mClob.size() || !mClob[symbol]) return false;
+    if (const engine::PriceLevel* bid = mClob[symbol]->buy_orders.bestLevel()) {
+        out.bid = {bid->price, bid->volume, bid->order_count};
+    }
+    if (const engine::PriceLevel* ask = mClob[symbol]->sell_orders.bestLevel()) {
+        out.ask = {ask->price, ask->volume, ask->order_count};
+    }
+    return true;
+}
+
+std::vector<std::string> MatchingEngine::snapshot(std::size_t max_levels) const {
+    std::vector<std::string> result;
+    appendSnapshot(result, max_levels);
+    return result;
+}
+
+void MatchingEngine::appendSnapshot(std::vector<std::string>& result, std::size_t max_levels) const {
+    for (const auto symbol: listedSymbols()) {
+        appendBook(symbol, max_levels, result);
+    }
+}
+
+std::vector<std::string_view> MatchingEngine::listedSymbols() const {
+    // Books are stored by symbol id, the output is in alphabetical order
+    std::vector<std::string_view> listed_symbols;
     for (const auto& node: mClob) {
-        // Add separator
-        std::string symbol_separator("===");
-        symbol_separator.append(node.first);
-        symbol_separator.append("===");
-        result.push_back(symbol_separator);
-        
-        // Add remaining unprocessed orders
-        std::map<double, int> remaining_sell_orders;
-        std::map<double, int> remaining_buy_orders;
+        if (node) listed_symbols.push_back(mSymbols.name(node->symbol_id));
+    }
+    std::sort(listed_symbols.begin(), listed_symbols.end());
+    return listed_symbols;
+}
+
+void MatchingEngine::appendBook(std::string_view symbol, std::size_t max_levels, std::vector<std::string>& result) const {
+    engine::BookDepth book;
+    if (!depth(symbol, max_levels, book)) return;
+
+    // Add separator
+    std::string symbol_separator("===");
+    symbol_separator.append(symbol);
+    symbol_separator.append("===");
+    result.push_back(symbol_separator);
+    
+    // Add remaining unprocessed orders, aggregated per level from the best price down
+    const auto max_len = std::max(book.bids.size(), book.asks.size());
+    for (std::size_t i=0; i<max_len; i++) {
         std::string remaining_orders;
-        while (!node.second->buy_orders.empty() || !node.second->sell_orders.empty()) {
-            const auto& best_buy_order = node.second->buy_orders.end();
-            if (!node.second->buy_orders.empty()) {
-                const auto& next_buy_order = std::prev(best_buy_order);
-                remaining_buy_orders[next_buy_order->price] += next_buy_order->volume;
-                node.second->buy_orders.erase(next_buy_order);
-            }
-            if (node.second->sell_orders.size() >= 1) {
-                const auto& next_sell_order = node.second->sell_orders.begin();
-                remaining_sell_orders[next_sell_order->price] += next_sell_order->volume;
-                node.second->sell_orders.erase(next_sell_order);
-            }            
-        }
-        auto max_len = std::max(remaining_sell_orders.size(), remaining_buy_orders.size());
-        for (auto i=0; i<max_len; i++) {
-            if (remaining_buy_orders.size() > i) {
-                auto buy_it = remaining_buy_orders.rbegin();
-                std::advance(buy_it, i);
-                remaining_orders.append(utils::dropTrailingZeroes(std::to_string(buy_it->first)));
-                remaining_orders.append(",");
-                remaining_orders.append(std::to_string(buy_it->second));
-            } else remaining_orders.append(",");
+        if (book.bids.size() > i) {
+            utils::appendPrice(remaining_orders, book.bids[i].price);
             remaining_orders.append(",");
-            if (remaining_sell_orders.size() > i) {
-                auto sell_it = remaining_sell_orders.begin();
-                std::advance(sell_it, i);
-                remaining_orders.append(utils::dropTrailingZeroes(std::to_string(sell_it->first)));
-                remaining_orders.append(",");
-                remaining_orders.append(std::to_string(sell_it->second));
-            } else remaining_orders.append(",");
-            result.push_back(remaining_orders);
-            remaining_orders = "";
-        }
+            utils::appendInteger(remaining_orders, book.bids[i].volume);
+        } else remaining_orders.append(",");
+        remaining_orders.append(",");
+        if (book.asks.size() > i) {
+            utils::appendPrice(remaining_orders, book.asks[i].price);
+            remaining_orders.append(",");
+            utils::appendInteger(remaining_orders, book.asks[i].volume);
+        } else remaining_orders.append(",");
+        result.push_back(std::move(remaining_orders));
     }
-    return result;
+}
+
+bool MatchingEngine::containsOrder(order::Id id) const {
+    return mOrderIndex.contains(id);
+}
+
+bool MatchingEngine::findOrder(order::Id id, engine::RestingOrder& out) const {
+    const auto* location = mOrderIndex.find(id);
+    if (location == nullptr) return false;
+    const Order* resting_order = location->order;
+    out = {location->node->symbol_id, resting_order->side, resting_order->price, resting_order->volume,
+           mOrderPool.details(resting_order)};
+    return true;
+}
+
+engine::EngineStatsSnapshot MatchingEngine::stats() const {
+    return mStats.snapshot();
 }
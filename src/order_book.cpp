@@ -0,0 +1,249 @@
+#include "order_book.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace engine {
+
+void PriceLevel::push_back(Order* order) {
+    order->next = nullptr;
+    order->prev = tail;
+    if (tail) {
+        tail->next = order;
+    } else {
+        head = order;
+    }
+    tail = order;
+    volume += order->volume;
+    ++order_count;
+}
+
+void PriceLevel::unlink(Order* order) {
+    if (order->prev) {
+        order->prev->next = order->next;
+    } else {
+        head = order->next;
+    }
+    if (order->next) {
+        order->next->prev = order->prev;
+    } else {
+        tail = order->prev;
+    }
+    order->prev = nullptr;
+    order->next = nullptr;
+    volume -= order->volume;
+    --order_count;
+}
+
+namespace {
+    constexpr std::size_t word_bits = 64;
+
+    // Highest set bit below `limit`, or `limit` if there is none
+    std::size_t highestBit(const std::vector<uint64_t>& words, std::size_t limit) {
+        for (std::size_t end = limit; end > 0;) {
+            const std::size_t word = (end - 1) / word_bits;
+            const uint64_t bits = words[word] & (~uint64_t(0) >> (word_bits - 1 - (end - 1) % word_bits));
+            if (bits) return word * word_bits + word_bits - 1 - static_cast<std::size_t>(__builtin_clzll(bits));
+            end = word * word_bits;
+        }
+        return limit;
+    }
+
+    // Lowest set bit from `start`, or words.size() * word_bits if there is none
+    std::size_t lowestBit(const std::vector<uint64_t>& words, std::size_t start) {
+        for (std::size_t word = start / word_bits; word < words.size(); ++word) {
+            const uint64_t bits = words[word] & (word * word_bits < start ? ~uint64_t(0) << (start % word_bits) : ~uint64_t(0));
+            if (bits) return word * word_bits + static_cast<std::size_t>(__builtin_ctzll(bits));
+        }
+        return words.size() * word_bits;
+    }
+}
+
+template <order::Side Side>
+BookSide<Side>::BookSide(const BookLayout& layout) {
+    mLevels.reserve(layout.reserved_levels);
+    if (layout.type != BookType::ladder || layout.ladder_levels == 0 || layout.tick_size <= 0) return;
+    const std::size_t words = (layout.ladder_levels + word_bits - 1) / word_bits;
+    mLadder.assign(words * word_bits, PriceLevel(0));
+    mOccupied.assign(words, 0);
+    mSummary.assign((words + word_bits - 1) / word_bits, 0);
+    mTick = layout.tick_size;
+}
+
+template <order::Side Side>
+std::vector<PriceLevel>::iterator BookSide<Side>::findLevel(order::Price price) {
+    // Most activity happens near the touch, so look at the best level before searching
+    if (!mLevels.empty() && mLevels.back().price == price) return std::prev(mLevels.end());
+    return std::lower_bound(mLevels.begin(), mLevels.end(), price,
+                            [](const PriceLevel& level, order::Price value) { return Traits::worse(level.price, value); });
+}
+
+template <order::Side Side>
+bool BookSide<Side>::insert(Order* order) {
+    if (!mLadder.empty()) {
+        std::size_t index = ladderIndex(order->price);
+        // The band follows the market: it moves onto a price on the grid that would be the new best
+        if (index == no_level && order->price % mTick == 0 &&
+            (mLadderCount == 0 || !Traits::worse(order->price, bestLevel()->price))) {
+            recentre(order->price);
+            index = ladderIndex(order->price);
+        }
+        if (index != no_level) {
+            PriceLevel& level = mLadder[index];
+            const bool new_level = level.empty();
+            if (new_level) {
+                level.price = order->price;
+                markLevel(index);
+            }
+            level.push_back(order);
+            return new_level;
+        }
+    }
+    auto level_it = findLevel(order->price);
+    const bool new_level = level_it == mLevels.end() || level_it->price != order->price;
+    if (new_level) {
+        level_it = mLevels.emplace(level_it, order->price);
+    }
+    level_it->push_back(order);
+    return new_level;
+}
+
+template <order::Side Side>
+bool BookSide<Side>::erase(Order* order) {
+    // A price inside the band is always on the ladder, recentring moves the sorted levels it covers
+    const std::size_t index = ladderIndex(order->price);
+    if (index != no_level) {
+        PriceLevel& level = mLadder[index];
+        level.unlink(order);
+        if (!level.empty()) return false;
+        clearLevel(index);
+        // The band follows a receding market too: once it is empty, it moves onto the best level left
+        if (mLadderCount == 0 && !mLevels.empty() && mLevels.back().price % mTick == 0) recentre(mLevels.back().price);
+        return true;
+    }
+    auto level_it = findLevel(order->price);
+    level_it->unlink(order);
+    if (!level_it->empty()) return false;
+    mLevels.erase(level_it);
+    return true;
+}
+
+template <order::Side Side>
+void BookSide<Side>::reduce(Order* order, int filled) {
+    const std::size_t index = ladderIndex(order->price);
+    if (index != no_level) {
+        mLadder[index].reduce(order, filled);
+    } else {
+        findLevel(order->price)->reduce(order, filled);
+    }
+}
+
+template <order::Side Side>
+const PriceLevel* BookSide<Side>::level(order::Price price) const {
+    const std::size_t index = ladderIndex(price);
+    if (index != no_level) return mLadder[index].empty() ? nullptr : &mLadder[index];
+    const auto level_it = std::lower_bound(mLevels.begin(), mLevels.end(), price,
+                                           [](const PriceLevel& level, order::Price value) { return Traits::worse(level.price, value); });
+    return level_it != mLevels.end() && level_it->price == price ? &*level_it : nullptr;
+}
+
+template <order::Side Side>
+void BookSide<Side>::depth(std::size_t max_levels, std::vector<DepthLevel>& out) const {
+    if (max_levels == 0) return;
+    std::size_t count = 0;
+    forEachLevel([&](const PriceLevel& level) {
+        out.push_back({level.price, level.volume, level.order_count});
+        return ++count < max_levels;
+    });
+}
+
+template <order::Side Side>
+std::size_t BookSide<Side>::highestLadderLevel(std::size_t limit) const {
+    if (limit == 0) return no_level;
+    const std::size_t word = (limit - 1) / word_bits;
+    const uint64_t bits = mOccupied[word] & (~uint64_t(0) >> (word_bits - 1 - (limit - 1) % word_bits));
+    if (bits) return word * word_bits + word_bits - 1 - static_cast<std::size_t>(__builtin_clzll(bits));
+    // The summary finds the next occupied word without looking at the empty ones
+    const std::size_t occupied_word = highestBit(mSummary, word);
+    if (occupied_word == word) return no_level;
+    return occupied_word * word_bits + word_bits - 1 - static_cast<std::size_t>(__builtin_clzll(mOccupied[occupied_word]));
+}
+
+template <order::Side Side>
+std::size_t BookSide<Side>::lowestLadderLevel(std::size_t start) const {
+    if (start >= mLadder.size()) return no_level;
+    const std::size_t word = start / word_bits;
+    const uint64_t bits = mOccupied[word] & (~uint64_t(0) << (start % word_bits));
+    if (bits) return word * word_bits + static_cast<std::size_t>(__builtin_ctzll(bits));
+    const std::size_t occupied_word = lowestBit(mSummary, word + 1);
+    if (occupied_word >= mOccupied.size()) return no_level;
+    return occupied_word * word_bits + static_cast<std::size_t>(__builtin_ctzll(mOccupied[occupied_word]));
+}
+
+template <order::Side Side>
+std::size_t BookSide<Side>::firstLadderLevel() const {
+    if constexpr (Side == order::Side::buy) {
+        return highestLadderLevel(mLadder.size());
+    } else {
+        return lowestLadderLevel(0);
+    }
+}
+
+template <order::Side Side>
+std::size_t BookSide<Side>::nextLadderLevel(std::size_t index) const {
+    if constexpr (Side == order::Side::buy) {
+        return highestLadderLevel(index);
+    } else {
+        return lowestLadderLevel(index + 1);
+    }
+}
+
+template <order::Side Side>
+void BookSide<Side>::markLevel(std::size_t index) {
+    const std::size_t word = index / word_bits;
+    mOccupied[word] |= uint64_t(1) << (index % word_bits);
+    mSummary[word / word_bits] |= uint64_t(1) << (word % word_bits);
+    ++mLadderCount;
+}
+
+template <order::Side Side>
+void BookSide<Side>::clearLevel(std::size_t index) {
+    const std::size_t word = index / word_bits;
+    mOccupied[word] &= ~(uint64_t(1) << (index % word_bits));
+    if (mOccupied[word] == 0) mSummary[word / word_bits] &= ~(uint64_t(1) << (word % word_bits));
+    --mLadderCount;
+}
+
+template <order::Side Side>
+void BookSide<Side>::recentre(order::Price price) {
+    // The levels on the ladder go to the sorted vector first, the new band takes back the ones it covers
+    if (mLadderCount > 0) {
+        for (std::size_t index = lowestLadderLevel(0); index != no_level; index = lowestLadderLevel(index + 1)) {
+            mLevels.push_back(mLadder[index]);
+            // A free ladder level is told apart by its empty queue
+            mLadder[index] = PriceLevel(0);
+        }
+        std::fill(mOccupied.begin(), mOccupied.end(), 0);
+        std::fill(mSummary.begin(), mSummary.end(), 0);
+        mLadderCount = 0;
+        std::sort(mLevels.begin(), mLevels.end(), [](const PriceLevel& lhs, const PriceLevel& rhs) {
+            return Traits::worse(lhs.price, rhs.price);
+        });
+    }
+    const order::Price half_band = static_cast<order::Price>(mLadder.size() / 2) * mTick;
+    mBase = price >= std::numeric_limits<order::Price>::min() + half_band ? price - half_band : price;
+    // The band may now cover sorted levels, they move over so every price has a single level
+    const auto moved = std::remove_if(mLevels.begin(), mLevels.end(), [this](const PriceLevel& level) {
+        const std::size_t index = ladderIndex(level.price);
+        if (index == no_level) return false;
+        mLadder[index] = level;
+        markLevel(index);
+        return true;
+    });
+    mLevels.erase(moved, mLevels.end());
+}
+
+template class BookSide<order::Side::buy>;
+template class BookSide<order::Side::sell>;
+
+} // engine namespace
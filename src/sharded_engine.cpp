@@ -0,0 +1,223 @@
+#include "sharded_engine.hpp"
+#include "string_utils.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string_view>
+
+namespace {
+    struct Job {
+        uint64_t sequence;
+        engine::Command command;
+        engine::RejectCode parsed;
+    };
+
+    constexpr std::size_t queue_capacity = 4096;
+    // Polls a waiting thread makes before it parks, enough to ride out the gaps within a batch
+    constexpr unsigned spin_limit = 1000;
+}
+
+struct ShardedMatchingEngine::Shard {
+    explicit Shard(const engine::EngineConfig& config)
+        : engine(sink, config)
+    {
+        worker = std::thread([this] { run(); });
+    }
+
+    engine::SequencedSink sink {};
+    MatchingEngine engine;
+    engine::SpscQueue<Job> queue {queue_capacity};
+    // Only touched by the front end
+    uint64_t dispatched = 0;
+    std::atomic<uint64_t> processed {0};
+    std::atomic<bool> running {true};
+    // A thread that found nothing to do for a while sleeps on its condition variable. Its flag tells
+    // the other side to take the mutex and wake it up, so a busy shard never touches the mutex.
+    std::mutex mutex {};
+    std::condition_variable worker_wakeup {};
+    std::condition_variable producer_wakeup {};
+    std::atomic<bool> worker_parked {false};
+    std::atomic<bool> producer_parked {false};
+    std::thread worker {};
+
+    void run() {
+        Job job;
+        while (true) {
+            if (!queue.tryPop(job)) {
+                if (!running.load(std::memory_order_acquire)) return;
+                await(worker_parked, worker_wakeup, [this] { return !queue.empty() || !running.load(std::memory_order_acquire); });
+                continue;
+            }
+            sink.sequence = job.sequence;
+            engine.processCommand(job.command, job.parsed);
+            processed.store(processed.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            // The front end may be waiting for room in the ring, or for the batch to be done
+            wake(producer_parked, producer_wakeup);
+        }
+    }
+
+    /*!
+    *  \brief Spins until `ready` holds, then parks until the other side calls wake() with the same flag.
+    */
+    template <typename Ready>
+    void await(std::atomic<bool>& parked, std::condition_variable& wakeup, Ready ready) {
+        for (unsigned spins = 0; spins < spin_limit; ++spins) {
+            if (ready()) return;
+            std::this_thread::yield();
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        parked.store(true, std::memory_order_relaxed);
+        // Pairs with the fence in wake(): either the other side sees the flag, or `ready` sees its progress
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        wakeup.wait(lock, ready);
+        parked.store(false, std::memory_order_relaxed);
+    }
+
+    void wake(std::atomic<bool>& parked, std::condition_variable& wakeup) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!parked.load(std::memory_order_relaxed)) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        wakeup.notify_one();
+    }
+};
+
+ShardedMatchingEngine::ShardedMatchingEngine(std::size_t shard_count, const engine::EngineConfig& config)
+    : mOrderShards(config.max_open_orders)
+{
+    if (shard_count == 0) shard_count = 1;
+    for (std::size_t i = 0; i < shard_count; ++i) {
+        mShards.push_back(std::make_unique<Shard>(config));
+    }
+}
+
+ShardedMatchingEngine::~ShardedMatchingEngine() {
+    for (auto& shard: mShards) {
+        shard->running.store(false, std::memory_order_release);
+        // Taken unconditionally, a worker checks `running` under the mutex before it sleeps
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->worker_wakeup.notify_one();
+    }
+    for (auto& shard: mShards) {
+        shard->worker.join();
+    }
+}
+
+uint32_t ShardedMatchingEngine::shardFor(std::string_view symbol) const {
+    return static_cast<uint32_t>(std::hash<std::string_view>{}(symbol) % mShards.size());
+}
+
+void ShardedMatchingEngine::dispatch(Shard& shard, uint64_t sequence, const engine::Command& command,
+                                     engine::RejectCode parsed) {
+    const Job job {sequence, command, parsed};
+    if (!shard.queue.tryPush(job)) {
+        shard.await(shard.producer_parked, shard.producer_wakeup, [&shard, &job] { return shard.queue.tryPush(job); });
+    }
+    ++shard.dispatched;
+    shard.wake(shard.worker_parked, shard.worker_wakeup);
+}
+
+void ShardedMatchingEngine::drain(Shard& shard) {
+    shard.await(shard.producer_parked, shard.producer_wakeup, [&shard] {
+        return shard.processed.load(std::memory_order_acquire) == shard.dispatched;
+    });
+}
+
+std::vector<std::string> ShardedMatchingEngine::processOrders(const std::vector<std::string>& input) {
+    if (input.empty()) return {};
+    engine::Command command;
+    for (uint64_t sequence = 0; sequence < input.size(); ++sequence) {
+        const auto parsed = utils::parseCommand(input[sequence], command);
+        if (parsed == engine::RejectCode::none && command.type == engine::CommandType::insert) {
+            const uint32_t target = shardFor(command.symbol);
+            uint32_t* known_shard = mOrderShards.find(command.id);
+            if (known_shard == nullptr) {
+                mOrderShards.insert(command.id, target);
+            } else if (*known_shard != target) {
+                // The id was used for another symbol, only that shard knows if it is still resting
+                Shard& previous_shard = *mShards[*known_shard];
+                drain(previous_shard);
+                if (previous_shard.engine.containsOrder(command.id)) {
+                    // That shard rejects it as a duplicate, in order with its other events
+                    dispatch(previous_shard, sequence, command, parsed);
+                    continue;
+                }
+                *known_shard = target;
+            }
+            dispatch(*mShards[target], sequence, command, parsed);
+        } else {
+            // Unknown ids and malformed lines go anywhere, the shard rejects them
+            const uint32_t* known_shard = mOrderShards.find(command.id);
+            if (known_shard && command.type == engine::CommandType::pull) mRetiredIds.push_back(command.id);
+            dispatch(*mShards[known_shard ? *known_shard : 0], sequence, command, parsed);
+        }
+    }
+
+    for (auto& shard: mShards) drain(*shard);
+
+    // Merge the trades and rejects back in input order, a command only ever trades on one shard
+    std::vector<engine::SequencedTrade> trades;
+    std::vector<engine::SequencedReject> rejects;
+    for (auto& shard: mShards) {
+        trades.insert(trades.end(), shard->sink.trades.begin(), shard->sink.trades.end());
+        rejects.insert(rejects.end(), shard->sink.rejects.begin(), shard->sink.rejects.end());
+        shard->sink.trades.clear();
+        shard->sink.rejects.clear();
+    }
+    for (const auto& sequenced_trade: trades) {
+        mRetiredIds.push_back(sequenced_trade.trade.aggressive_id);
+        mRetiredIds.push_back(sequenced_trade.trade.passive_id);
+    }
+    for (const auto& sequenced_reject: rejects) {
+        if (sequenced_reject.reject.type == engine::CommandType::insert) mRetiredIds.push_back(sequenced_reject.reject.id);
+    }
+    forgetRetiredIds();
+    std::stable_sort(trades.begin(), trades.end(), [](const engine::SequencedTrade& lhs, const engine::SequencedTrade& rhs) {
+        return lhs.sequence < rhs.sequence;
+    });
+    // A rejected command does not trade, so rejects never share a sequence with trades
+    std::sort(rejects.begin(), rejects.end(), [](const engine::SequencedReject& lhs, const engine::SequencedReject& rhs) {
+        return lhs.sequence < rhs.sequence;
+    });
+    std::vector<std::string> result;
+    result.reserve(trades.size() + rejects.size());
+    auto next_reject = rejects.begin();
+    for (const auto& sequenced_trade: trades) {
+        for (; next_reject != rejects.end() && next_reject->sequence < sequenced_trade.sequence; ++next_reject) {
+            std::string line;
+            engine::appendReject(line, next_reject->reject);
+            result.push_back(std::move(line));
+        }
+        std::string line;
+        engine::appendTrade(line, sequenced_trade.trade);
+        result.push_back(std::move(line));
+    }
+    for (; next_reject != rejects.end(); ++next_reject) {
+        std::string line;
+        engine::appendReject(line, next_reject->reject);
+        result.push_back(std::move(line));
+    }
+
+    // Then the books of every shard, in alphabetical order
+    std::vector<std::pair<std::string_view, const MatchingEngine*>> books;
+    for (const auto& shard: mShards) {
+        for (const auto symbol: shard->engine.listedSymbols()) {
+            books.emplace_back(symbol, &shard->engine);
+        }
+    }
+    std::sort(books.begin(), books.end());
+    for (const auto& [symbol, shard_engine]: books) {
+        shard_engine->appendBook(symbol, std::numeric_limits<std::size_t>::max(), result);
+    }
+    return result;
+}
+
+void ShardedMatchingEngine::forgetRetiredIds() {
+    // The shards are drained, so their books can be read from here
+    for (const order::Id id: mRetiredIds) {
+        const uint32_t* known_shard = mOrderShards.find(id);
+        if (known_shard && !mShards[*known_shard]->engine.containsOrder(id)) mOrderShards.erase(id);
+    }
+    mRetiredIds.clear();
+}
@@ -0,0 +1,186 @@
+#include "shared_book.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace engine {
+
+namespace {
+    // A record only stays odd while the publisher writes a few levels, this is a generous bound
+    constexpr int max_read_attempts = 1000;
+
+    std::size_t recordSize(std::size_t depth) {
+        const std::size_t size = sizeof(SharedBookRecord) + 2 * depth * sizeof(SharedLevel);
+        return (size + alignof(SharedBookRecord) - 1) / alignof(SharedBookRecord) * alignof(SharedBookRecord);
+    }
+
+    const SharedLevel* levelsOf(const SharedBookRecord& record) {
+        return reinterpret_cast<const SharedLevel*>(reinterpret_cast<const char*>(&record) + sizeof(SharedBookRecord));
+    }
+
+    SharedLevel* levelsOf(SharedBookRecord& record) {
+        return reinterpret_cast<SharedLevel*>(reinterpret_cast<char*>(&record) + sizeof(SharedBookRecord));
+    }
+
+    template <typename Side>
+    uint32_t writeLevels(const Side& side, SharedLevel* out, std::size_t depth) {
+        uint32_t count = 0;
+        if (depth == 0) return count;
+        side.forEachLevel([&](const PriceLevel& level) {
+            out[count].price.store(level.price, std::memory_order_relaxed);
+            out[count].volume.store(level.volume, std::memory_order_relaxed);
+            out[count].order_count.store(level.order_count, std::memory_order_relaxed);
+            return ++count < depth;
+        });
+        return count;
+    }
+
+    void readLevels(const SharedLevel* levels, uint32_t count, std::vector<DepthLevel>& out) {
+        out.clear();
+        for (uint32_t i = 0; i < count; ++i) {
+            out.push_back({levels[i].price.load(std::memory_order_relaxed), levels[i].volume.load(std::memory_order_relaxed),
+                           levels[i].order_count.load(std::memory_order_relaxed)});
+        }
+    }
+}
+
+SharedBookPublisher::SharedBookPublisher(const std::string& name, std::size_t max_symbols, std::size_t depth)
+    : mName(name)
+    , mSize(sizeof(SharedBookHeader) + max_symbols * recordSize(depth))
+{
+    // Whatever an earlier run left behind is dropped, readers that open the name get the new region
+    ::shm_unlink(name.c_str());
+    const int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Error: Cannot create shared memory " + name);
+    }
+    if (::ftruncate(fd, static_cast<off_t>(mSize)) != 0) {
+        ::close(fd);
+        ::shm_unlink(name.c_str());
+        throw std::runtime_error("Error: Cannot size shared memory " + name);
+    }
+    // Populated now, so the first publish of a record does not fault its page in
+    void* mapping = ::mmap(nullptr, mSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        ::shm_unlink(name.c_str());
+        throw std::runtime_error("Error: Cannot map shared memory " + name);
+    }
+
+    char* base = static_cast<char*>(mapping);
+    mHeader = new (base) SharedBookHeader{};
+    mHeader->max_symbols = static_cast<uint32_t>(max_symbols);
+    mHeader->depth = static_cast<uint32_t>(depth);
+    mHeader->record_size = recordSize(depth);
+    for (std::size_t i = 0; i < max_symbols; ++i) {
+        SharedBookRecord* target = new (base + sizeof(SharedBookHeader) + i * mHeader->record_size) SharedBookRecord{};
+        for (std::size_t level = 0; level < 2 * depth; ++level) {
+            new (levelsOf(*target) + level) SharedLevel{};
+        }
+    }
+    // Readers check the magic first, it goes in once the rest is in place
+    std::atomic_thread_fence(std::memory_order_release);
+    mHeader->magic = shared_book_magic;
+}
+
+SharedBookPublisher::~SharedBookPublisher() {
+    ::munmap(mHeader, mSize);
+    ::shm_unlink(mName.c_str());
+}
+
+SharedBookRecord& SharedBookPublisher::record(SymbolId symbol) {
+    return *reinterpret_cast<SharedBookRecord*>(reinterpret_cast<char*>(mHeader) + sizeof(SharedBookHeader)
+                                                + symbol * mHeader->record_size);
+}
+
+void SharedBookPublisher::publish(const TradeNode& node, std::string_view symbol, order::Sequence sequence) {
+    if (node.symbol_id >= mHeader->max_symbols) return;
+    SharedBookRecord& target = record(node.symbol_id);
+    if (target.ready.load(std::memory_order_relaxed) == 0) {
+        const std::size_t length = std::min(symbol.size(), sizeof(target.symbol) - 1);
+        std::memcpy(target.symbol, symbol.data(), length);
+        target.symbol[length] = '\0';
+        target.ready.store(1, std::memory_order_release);
+        if (node.symbol_id >= mHeader->symbol_count.load(std::memory_order_relaxed)) {
+            mHeader->symbol_count.store(node.symbol_id + 1, std::memory_order_release);
+        }
+    }
+
+    // Odd while writing, the fence keeps the level stores behind it
+    const uint64_t version = target.version.load(std::memory_order_relaxed);
+    target.version.store(version + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    target.sequence.store(sequence, std::memory_order_relaxed);
+    SharedLevel* levels = levelsOf(target);
+    target.bid_count.store(writeLevels(node.buy_orders, levels, mHeader->depth), std::memory_order_relaxed);
+    target.ask_count.store(writeLevels(node.sell_orders, levels + mHeader->depth, mHeader->depth), std::memory_order_relaxed);
+    target.version.store(version + 2, std::memory_order_release);
+}
+
+SharedBookReader::SharedBookReader(const std::string& name) {
+    const int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        throw std::runtime_error("Error: Cannot open shared memory " + name);
+    }
+    struct stat region_stat;
+    if (::fstat(fd, &region_stat) != 0 || static_cast<std::size_t>(region_stat.st_size) < sizeof(SharedBookHeader)) {
+        ::close(fd);
+        throw std::runtime_error("Error: Not a shared book " + name);
+    }
+    mSize = static_cast<std::size_t>(region_stat.st_size);
+    void* mapping = ::mmap(nullptr, mSize, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Error: Cannot map shared memory " + name);
+    }
+    mHeader = static_cast<const SharedBookHeader*>(mapping);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (mHeader->magic != shared_book_magic || mHeader->record_size != recordSize(mHeader->depth)
+        || sizeof(SharedBookHeader) + uint64_t(mHeader->max_symbols) * mHeader->record_size != mSize) {
+        ::munmap(mapping, mSize);
+        throw std::runtime_error("Error: Not a shared book " + name);
+    }
+}
+
+SharedBookReader::~SharedBookReader() {
+    ::munmap(const_cast<SharedBookHeader*>(mHeader), mSize);
+}
+
+const SharedBookRecord& SharedBookReader::record(SymbolId symbol) const {
+    return *reinterpret_cast<const SharedBookRecord*>(reinterpret_cast<const char*>(mHeader) + sizeof(SharedBookHeader)
+                                                      + symbol * mHeader->record_size);
+}
+
+std::size_t SharedBookReader::symbolCount() const {
+    return std::min<std::size_t>(mHeader->symbol_count.load(std::memory_order_acquire), mHeader->max_symbols);
+}
+
+bool SharedBookReader::read(SymbolId symbol, SharedBookView& out) const {
+    if (symbol >= symbolCount()) return false;
+    const SharedBookRecord& source = record(symbol);
+    if (source.ready.load(std::memory_order_acquire) == 0) return false;
+    out.symbol.assign(source.symbol, strnlen(source.symbol, sizeof(source.symbol)));
+
+    const SharedLevel* levels = levelsOf(source);
+    const uint32_t depth = mHeader->depth;
+    for (int attempt = 0; attempt < max_read_attempts; ++attempt) {
+        const uint64_t version = source.version.load(std::memory_order_acquire);
+        if (version % 2 != 0) continue;
+        out.sequence = source.sequence.load(std::memory_order_relaxed);
+        readLevels(levels, std::min(source.bid_count.load(std::memory_order_relaxed), depth), out.bids);
+        readLevels(levels + depth, std::min(source.ask_count.load(std::memory_order_relaxed), depth), out.asks);
+        // The copy is good if no write started while it was taken
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (source.version.load(std::memory_order_relaxed) == version) return true;
+    }
+    return false;
+}
+
+} // engine namespace
@@ -0,0 +1,140 @@
+#include "snapshot.hpp"
+#include "mapped_file.hpp"
+#include "matching_engine.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+    template <typename T>
+    void appendBytes(std::vector<char>& out, const T& value) {
+        const char* bytes = reinterpret_cast<const char*>(&value);
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+}
+
+void MatchingEngine::writeSnapshot(const std::string& path) {
+    engine::SnapshotHeader header {};
+    header.magic = engine::snapshot_magic;
+    header.sequence = mSequence;
+    if (mJournal) {
+        mJournal->commit();
+        header.journal_offset = mJournal->offset();
+    }
+    header.order_count = mOrderIndex.size();
+    header.symbol_count = mSymbols.size();
+
+    std::vector<char> data;
+    data.reserve(sizeof(header) + header.order_count * sizeof(engine::SnapshotOrder));
+    appendBytes(data, header);
+    for (const auto& node: mClob) {
+        if (!node) continue;
+        const auto append_side = [&](const auto& side) {
+            side.forEachLevel([&](const engine::PriceLevel& level) {
+                for (const Order* order = level.head; order != nullptr; order = order->next) {
+                    const OrderDetails& details = mOrderPool.details(order);
+                    engine::SnapshotOrder record {};
+                    record.id = order->id;
+                    record.price = order->price;
+                    record.last_updated = order->last_updated;
+                    record.entered = details.entered;
+                    record.amended = details.amended;
+                    record.symbol = node->symbol_id;
+                    record.volume = order->volume;
+                    record.original_volume = details.original_volume;
+                    record.side = order->side;
+                    appendBytes(data, record);
+                }
+                return true;
+            });
+        };
+        append_side(node->buy_orders);
+        append_side(node->sell_orders);
+    }
+    uint32_t name_offset = 0;
+    for (engine::SymbolId id = 0; id < mSymbols.size(); ++id) {
+        const auto& name = mSymbols.name(id);
+        const bool listed = id < mClob.size() && mClob[id];
+        appendBytes(data, engine::SnapshotSymbol{name_offset, static_cast<uint32_t>(name.size()), listed});
+        name_offset += static_cast<uint32_t>(name.size());
+    }
+    for (engine::SymbolId id = 0; id < mSymbols.size(); ++id) {
+        data.insert(data.end(), mSymbols.name(id).begin(), mSymbols.name(id).end());
+    }
+    header.names_size = name_offset;
+    std::memcpy(data.data(), &header, sizeof(header));
+
+    const std::string temporary_path = path + ".tmp";
+    std::FILE* file = std::fopen(temporary_path.c_str(), "wb");
+    if (file == nullptr) {
+        throw std::runtime_error("Error: Cannot open " + temporary_path);
+    }
+    const bool written = std::fwrite(data.data(), 1, data.size(), file) == data.size()
+                         && std::fflush(file) == 0
+                         && ::fsync(fileno(file)) == 0;
+    std::fclose(file);
+    if (!written || std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+        std::remove(temporary_path.c_str());
+        throw std::runtime_error("Error: Cannot write " + path);
+    }
+}
+
+engine::SnapshotInfo MatchingEngine::loadSnapshot(const std::string& path) {
+    if (mSymbols.size() != 0 || !mOrderIndex.empty() || mSequence != 0) {
+        throw std::runtime_error("Error: Snapshots can only be loaded into a fresh engine");
+    }
+    const engine::MappedFile file(path);
+    const auto corrupt = [&path]() { return std::runtime_error("Error: Corrupt snapshot " + path); };
+
+    engine::SnapshotHeader header;
+    if (file.size() < sizeof(header)) throw corrupt();
+    std::memcpy(&header, file.data(), sizeof(header));
+    const uint64_t orders_end = sizeof(header) + header.order_count * sizeof(engine::SnapshotOrder);
+    const uint64_t symbols_end = orders_end + header.symbol_count * sizeof(engine::SnapshotSymbol);
+    if (header.magic != engine::snapshot_magic || header.order_count > file.size() || header.symbol_count > file.size()
+        || symbols_end + header.names_size != file.size()) {
+        throw corrupt();
+    }
+
+    // Symbols first, orders refer to them by id
+    const char* names = file.data() + symbols_end;
+    for (uint64_t id = 0; id < header.symbol_count; ++id) {
+        engine::SnapshotSymbol symbol;
+        std::memcpy(&symbol, file.data() + orders_end + id * sizeof(symbol), sizeof(symbol));
+        if (uint64_t(symbol.name_offset) + symbol.name_size > header.names_size
+            || mSymbols.intern({names + symbol.name_offset, symbol.name_size}) != id) {
+            throw corrupt();
+        }
+        if (symbol.listed) {
+            mClob.resize(mSymbols.size());
+            mClob[id] = std::make_unique<engine::TradeNode>(id, bookLayout());
+        }
+    }
+
+    // Orders are stored in queue order, so appending each one rebuilds its level as it was
+    mOrderIndex.reserve(header.order_count);
+    for (uint64_t i = 0; i < header.order_count; ++i) {
+        engine::SnapshotOrder record;
+        std::memcpy(&record, file.data() + sizeof(header) + i * sizeof(record), sizeof(record));
+        // Held to the same rules as live orders, a bad record would otherwise rest where no command can put it
+        const bool valid_side = record.side == order::Side::buy || record.side == order::Side::sell;
+        if (!valid_side || record.volume <= 0 || !order::isValidPrice(record.price) || record.symbol >= mClob.size()
+            || !mClob[record.symbol]) {
+            throw corrupt();
+        }
+        engine::TradeNode* node = mClob[record.symbol].get();
+        Order* resting_order = mOrderPool.allocate({record.id, record.side, record.price, record.volume, record.last_updated},
+                                                   {record.original_volume, record.entered, record.amended});
+        if (!mOrderIndex.insert(record.id, {node, resting_order})) throw corrupt();
+        linkOrder(*node, resting_order);
+    }
+    mSequence = header.sequence;
+    mStats.onRestingOrders(mOrderIndex.size());
+    // Every level of the loaded books, so a subscriber starts from the same state
+    publishChanges();
+    return {header.sequence, header.journal_offset, static_cast<std::size_t>(header.order_count)};
+}
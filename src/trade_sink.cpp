@@ -0,0 +1,100 @@
+#include "trade_sink.hpp"
+#include "string_utils.hpp"
+
+#include <stdexcept>
+
+namespace engine {
+
+void appendTrade(std::string& out, const TradeEvent& trade) {
+    out.append(trade.symbol);
+    out.append(",");
+    utils::appendPrice(out, trade.price);
+    out.append(",");
+    utils::appendInteger(out, trade.volume);
+    out.append(",");
+    utils::appendInteger(out, trade.aggressive_id);
+    out.append(",");
+    utils::appendInteger(out, trade.passive_id);
+}
+
+void appendReject(std::string& out, const RejectEvent& reject) {
+    out.append("REJECT,");
+    utils::appendInteger(out, reject.id);
+    out.append(",");
+    out.append(rejectReason(reject.code));
+}
+
+void StringSink::onTrade(const TradeEvent& trade) {
+    std::string line;
+    appendTrade(line, trade);
+    mLines.push_back(std::move(line));
+}
+
+void StringSink::onReject(const RejectEvent& reject) {
+    std::string line;
+    appendReject(line, reject);
+    mLines.push_back(std::move(line));
+}
+
+std::vector<std::string> StringSink::take() {
+    std::vector<std::string> lines;
+    lines.swap(mLines);
+    return lines;
+}
+
+BufferedFileSink::BufferedFileSink(const std::string& path, std::size_t buffer_size)
+    : mFile(std::fopen(path.c_str(), "wb"))
+    , mOwnsFile(true)
+    , mBufferSize(buffer_size)
+{
+    if (mFile == nullptr) {
+        throw std::runtime_error("Error: Cannot open " + path);
+    }
+    mBuffer.reserve(mBufferSize);
+}
+
+BufferedFileSink::BufferedFileSink(std::FILE* file, std::size_t buffer_size)
+    : mFile(file)
+    , mOwnsFile(false)
+    , mBufferSize(buffer_size)
+{
+    mBuffer.reserve(mBufferSize);
+}
+
+BufferedFileSink::~BufferedFileSink() {
+    // Nowhere to report a failure from here
+    writeBuffer();
+    if (mOwnsFile) {
+        std::fclose(mFile);
+    } else if (!mFailed) {
+        std::fflush(mFile);
+    }
+}
+
+void BufferedFileSink::onTrade(const TradeEvent& trade) {
+    if (mFailed) return;
+    appendTrade(mBuffer, trade);
+    mBuffer.push_back('\n');
+    if (mBuffer.size() >= mBufferSize) writeBuffer();
+}
+
+void BufferedFileSink::onReject(const RejectEvent& reject) {
+    if (mFailed) return;
+    appendReject(mBuffer, reject);
+    mBuffer.push_back('\n');
+    if (mBuffer.size() >= mBufferSize) writeBuffer();
+}
+
+void BufferedFileSink::writeBuffer() {
+    // Called from the matching loop, so a failure must not unwind through it
+    if (!mFailed && std::fwrite(mBuffer.data(), 1, mBuffer.size(), mFile) != mBuffer.size()) mFailed = true;
+    mBuffer.clear();
+}
+
+void BufferedFileSink::flush() {
+    writeBuffer();
+    if (!mFailed && std::fflush(mFile) != 0) mFailed = true;
+    if (mFailed) throw std::runtime_error("Error: Cannot write trades");
+}
+
+} // engine namespace
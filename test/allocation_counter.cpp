@@ -0,0 +1,46 @@
+#include "allocation_counter.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Replaces the global allocator for the whole test binary, only to count the calls.
+// Kept in its own translation unit so the replacement is never inlined into callers.
+// Over-aligned types, like Order and the OrderPool chunks, go through the align_val_t overloads.
+
+namespace {
+    std::atomic<std::size_t> allocation_count {0};
+}
+
+std::size_t allocationCount() {
+    return allocation_count.load();
+}
+
+void* operator new(std::size_t size) {
+    ++allocation_count;
+    if (void* memory = std::malloc(size > 0 ? size : 1)) return memory;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    ++allocation_count;
+    void* memory = nullptr;
+    if (::posix_memalign(&memory, static_cast<std::size_t>(alignment), size > 0 ? size : 1) == 0) return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept {
+    std::free(memory);
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstddef>
+
+/*!
+*  \brief Number of calls to the global operator new, aligned or not, made so far by the test binary.
+*/
+std::size_t allocationCount();